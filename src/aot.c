@@ -0,0 +1,271 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "aot.h"
+#include "block.h"
+#include "mem.h"
+
+#define BANK_SIZE 0x4000
+#define BANK_COUNT 0x100
+
+/*
+ * Switchable banks with the same contents are recompiled once.
+ * bank_group maps each ROM bank index to its group (-1 if it points
+ * past the end of the cartridge) and group_bank is the first bank of
+ * each group. seen marks the block starts of each group that were
+ * queued (2 if nothing decodes there), fixed_seen those of
+ * 0x0000-0x3FFF.
+ */
+int bank_group[BANK_COUNT];
+uint8_t group_bank[BANK_COUNT];
+int group_count;
+uint8_t *seen[BANK_COUNT];
+uint8_t fixed_seen[BANK_SIZE];
+
+/* Pending block starts as group << 16 | addr */
+uint32_t *queue;
+int queue_len, queue_size;
+
+/* FNV-1a hash of the cartridge, ties recompiled code to its ROM */
+uint32_t rom_hash(uint8_t *cart_mem, long size) {
+	uint32_t h = 2166136261u;
+	long i;
+	for (i = 0; i < size; i++) {
+		h ^= cart_mem[i];
+		h *= 16777619u;
+	}
+	return h;
+}
+
+void find_groups(uint8_t *cart_mem, long size) {
+	int i, g;
+	uint8_t *p;
+	group_count = 0;
+	for (i = 0; i < BANK_COUNT; i++) {
+		set_rom_bank(i);
+		p = get_mem_ptr(SW16_ROM_BANK);
+		bank_group[i] = -1;
+		if (p != &gb_mem[SW16_ROM_BANK]
+			&& (p < cart_mem || p + BANK_SIZE > cart_mem + size))
+			continue;
+		for (g = 0; g < group_count; g++) {
+			set_rom_bank(group_bank[g]);
+			if (!memcmp(p, get_mem_ptr(SW16_ROM_BANK), BANK_SIZE))
+				break;
+		}
+		if (g == group_count) {
+			group_bank[group_count++] = i;
+			seen[g] = calloc(BANK_SIZE, sizeof(uint8_t));
+		}
+		bank_group[i] = g;
+	}
+}
+
+void enqueue(int group, uint16_t addr) {
+	uint8_t *s;
+	if (addr >= VIDEO_RAM)
+		return;
+	if (addr < SW16_ROM_BANK) {
+		group = 0;
+		s = &fixed_seen[addr];
+	} else {
+		s = &seen[group][addr - SW16_ROM_BANK];
+	}
+	if (*s)
+		return;
+	*s = 1;
+	if (queue_len == queue_size) {
+		queue_size = queue_size ? queue_size * 2 : 0x400;
+		queue = realloc(queue, queue_size * sizeof(uint32_t));
+	}
+	queue[queue_len++] = group << 16 | addr;
+}
+
+/*
+ * Queues a branch target. Code in the fixed bank can reach the
+ * switchable bank with any ROM bank selected.
+ */
+void enqueue_target(int group, uint16_t from, uint16_t addr) {
+	int g;
+	if (from < SW16_ROM_BANK && addr >= SW16_ROM_BANK) {
+		for (g = 0; g < group_count; g++)
+			enqueue(g, addr);
+	} else {
+		enqueue(group, addr);
+	}
+}
+
+void block_name(FILE *fp, int group, uint16_t addr) {
+	if (addr < SW16_ROM_BANK)
+		fprintf(fp, "rom_%04X", addr);
+	else
+		fprintf(fp, "bank%02X_%04X", group_bank[group], addr);
+}
+
+/*
+ * Writes the block at addr as a function with an AOT_OP or AOT_CB
+ * line per instruction and queues where control can go once it ends.
+ * Returns 0 if no instruction at addr decodes.
+ */
+int emit_block(FILE *fp, int group, uint16_t addr) {
+	uint32_t end = addr < SW16_ROM_BANK ? SW16_ROM_BANK : VIDEO_RAM;
+	uint16_t pc = addr, at = addr;
+	uint8_t op[3];
+	uint8_t len;
+	int ended = 0;
+
+	set_rom_bank(group_bank[group]);
+	op[0] = get_mem(pc);
+	len = op_length[op[0]];
+	if (!len || pc + len > end)
+		return 0;
+	fprintf(fp, "static void ");
+	block_name(fp, group, addr);
+	fprintf(fp, "(struct gb_state *state) {\n");
+	while (1) {
+		op[0] = get_mem(pc);
+		len = op_length[op[0]];
+		if (!len || pc + len > end)
+			break;
+		op[1] = len > 1 ? get_mem(pc + 1) : 0;
+		op[2] = len > 2 ? get_mem(pc + 2) : 0;
+		if (op[0] == 0xCB)
+			fprintf(fp, "\tAOT_CB(0x%04X, 0x%02X, 0x%04X);\n",
+				pc, op[1], (uint16_t)(pc + len));
+		else
+			fprintf(fp, "\tAOT_OP(0x%04X, 0x%02X, 0x%02X, 0x%02X, 0x%04X);\n",
+				pc, op[0], op[1], op[2], (uint16_t)(pc + len));
+		at = pc;
+		pc += len;
+		if (ends_block(op[0])) {
+			ended = 1;
+			break;
+		}
+	}
+	fprintf(fp, "}\n\n");
+
+	// the walk stops at data that does not decode
+	if (!ended)
+		return 1;
+	uint16_t nn = ((uint16_t)op[2] << 8) | op[1];
+	switch (op[0]) {
+		case 0x18: case 0x20: case 0x28: case 0x30: case 0x38:
+			enqueue_target(group, at, pc + (int8_t)op[1]);
+			break;
+		case 0xC2: case 0xC3: case 0xC4: case 0xCA: case 0xCC: case 0xCD:
+		case 0xD2: case 0xD4: case 0xDA: case 0xDC:
+			enqueue_target(group, at, nn);
+			break;
+		case 0xC7: case 0xCF: case 0xD7: case 0xDF:
+		case 0xE7: case 0xEF: case 0xF7: case 0xFF:
+			enqueue(0, op[0] & 0x38);
+			break;
+	}
+	// everything but JR, JP, JP (HL), RET and RETI can carry on after it
+	switch (op[0]) {
+		case 0x18: case 0xC3: case 0xE9: case 0xC9: case 0xD9:
+			break;
+		default:
+			enqueue_target(group, at, pc);
+	}
+	return 1;
+}
+
+void emit_lookup(FILE *fp) {
+	int g, i, addr, all = 1;
+	fprintf(fp, "aot_fn aot_block(uint8_t bank, uint16_t pc) {\n");
+	fprintf(fp, "\tif (pc < 0x%04X) {\n\t\tswitch (pc) {\n", SW16_ROM_BANK);
+	for (addr = 0; addr < BANK_SIZE; addr++) {
+		if (fixed_seen[addr] != 1)
+			continue;
+		fprintf(fp, "\t\t\tcase 0x%04X: return ", addr);
+		block_name(fp, 0, addr);
+		fprintf(fp, ";\n");
+	}
+	fprintf(fp, "\t\t}\n\t\treturn NULL;\n\t}\n");
+	fprintf(fp, "\tif (pc >= 0x%04X)\n\t\treturn NULL;\n", VIDEO_RAM);
+
+	for (i = 0; i < BANK_COUNT; i++)
+		all &= bank_group[i] == 0;
+	fprintf(fp, "\tswitch (bank) {\n");
+	for (g = 0; g < group_count; g++) {
+		if (all) {
+			fprintf(fp, "\t\tdefault:\n");
+		} else {
+			for (i = 0; i < BANK_COUNT; i++) {
+				if (bank_group[i] == g)
+					fprintf(fp, "\t\tcase 0x%02X:\n", i);
+			}
+		}
+		fprintf(fp, "\t\t\tswitch (pc) {\n");
+		for (addr = SW16_ROM_BANK; addr < VIDEO_RAM; addr++) {
+			if (seen[g][addr - SW16_ROM_BANK] != 1)
+				continue;
+			fprintf(fp, "\t\t\t\tcase 0x%04X: return ", addr);
+			block_name(fp, g, addr);
+			fprintf(fp, ";\n");
+		}
+		fprintf(fp, "\t\t\t}\n\t\t\tbreak;\n");
+	}
+	fprintf(fp, "\t}\n\treturn NULL;\n}\n");
+}
+
+/*
+ * Recompiles the cartridge into a C file at path. Blocks are found by
+ * walking the code from the entry point and the interrupt vectors and
+ * following every branch, call and restart whose target is known.
+ * setup_mem_banks must have been run on cart_mem.
+ * Returns nonzero if the file cannot be written.
+ */
+int recompile(uint8_t *cart_mem, long size, char *path) {
+	FILE *fp = fopen(path, "w");
+	int i, g, blocks = 0;
+	uint16_t addr;
+	if (!fp) {
+		fprintf(stderr, "Failed to open file %s\n", path);
+		return 1;
+	}
+	gb_mem = calloc(0x10000, sizeof(uint8_t));
+	memcpy(gb_mem, cart_mem, size < VIDEO_RAM ? size : VIDEO_RAM);
+	map_pages();
+	find_groups(cart_mem, size);
+
+	fprintf(fp, "/* Generated by gbem -a, do not edit */\n\n");
+	fprintf(fp, "#define AOT_BLOCKS\n#include \"aot.h\"\n\n");
+	fprintf(fp, "const uint32_t aot_rom_hash = 0x%08X;\n\n", rom_hash(cart_mem, size));
+
+	enqueue(0, 0x0100);
+	for (i = VBLANK_ADDR; i <= P10_P13_TRANSITION_ADDR; i += 8)
+		enqueue(0, i);
+	for (i = 0; i < queue_len; i++) {
+		g = queue[i] >> 16;
+		addr = queue[i] & 0xFFFF;
+		if (emit_block(fp, g, addr))
+			blocks++;
+		else if (addr < SW16_ROM_BANK)
+			fixed_seen[addr] = 2;
+		else
+			seen[g][addr - SW16_ROM_BANK] = 2;
+	}
+	emit_lookup(fp);
+	fclose(fp);
+
+	set_rom_bank(0);
+	printf("%d blocks in %d banks written to %s\n", blocks, group_count, path);
+	return 0;
+}
+
+#ifdef AOT
+uint8_t aot_ready = 0;
+
+/*
+ * Enables the recompiled code if it was generated from this cartridge.
+ * Returns nonzero if it was not.
+ */
+int aot_load(uint8_t *cart_mem, long size) {
+	aot_ready = rom_hash(cart_mem, size) == aot_rom_hash;
+	return !aot_ready;
+}
+#endif
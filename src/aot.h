@@ -0,0 +1,94 @@
+#ifndef AOT_H
+#define AOT_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "cpu.h"
+#include "mem.h"
+#include "block.h"
+
+/* A recompiled block, runs from its start until control leaves it */
+typedef void (*aot_fn)(struct gb_state *state);
+
+uint32_t rom_hash(uint8_t *cart_mem, long size);
+int recompile(uint8_t *cart_mem, long size, char *path);
+
+#ifdef AOT
+/*
+ * Provided by the translation unit recompile() wrote. aot_block
+ * returns the block starting at pc with the given ROM bank selected
+ * or NULL if the walk never reached it.
+ */
+extern const uint32_t aot_rom_hash;
+aot_fn aot_block(uint8_t bank, uint16_t pc);
+
+/* Set by aot_load() when the cartridge is the recompiled one */
+extern uint8_t aot_ready;
+int aot_load(uint8_t *cart_mem, long size);
+#endif
+
+#ifdef AOT_BLOCKS
+/*
+ * Every handler in opcodes.h becomes a function aot_op_<opcode> and
+ * every handler in opcodes_cb.h a function aot_cb_<opcode> so that
+ * recompiled blocks call the handler of each instruction directly.
+ * They return the cycles of the instruction.
+ */
+#define AOT_HANDLER(name, c) \
+	static inline int name(struct gb_state *state, uint16_t pc, uint8_t *op, uint16_t nn) { \
+		struct gb_state *regs __attribute__((unused)) = state; \
+		int cycles = c; \
+		uint8_t tmp __attribute__((unused));
+#define NEXT return cycles
+#define CB_PREFIX
+
+#define OP(n) return cycles; } AOT_HANDLER(aot_op_##n, 4)
+AOT_HANDLER(aot_op_none, 4)
+#include "opcodes.h"
+	return cycles;
+}
+#undef OP
+
+#define OP(n) return cycles; } AOT_HANDLER(aot_cb_##n, 8)
+AOT_HANDLER(aot_cb_none, 8)
+#include "opcodes_cb.h"
+	return cycles;
+}
+#undef OP
+#undef NEXT
+#undef CB_PREFIX
+
+/*
+ * Finishes an instruction the way run_cached does. Returns nonzero
+ * when the block has to be left (the ROM bank was switched or the CPU
+ * halted).
+ */
+static inline int aot_finish(struct gb_state *state, uint16_t pc, uint8_t *op, int cycles) {
+	finish_instruction(state, pc, op, cycles);
+	clock_cycles(state, cycles);
+	return block_exit || state->halt;
+}
+
+/* Runs the instruction at at and leaves the block unless it goes on at next */
+#define AOT_OP(at, o0, o1, o2, next) do { \
+	uint8_t op[3] = {o0, o1, o2}; \
+	state->pc++; \
+	if (aot_finish(state, at, op, aot_op_##o0(state, at, op, (o2) << 8 | (o1))) \
+		|| state->pc != (next)) \
+		return; \
+} while (0)
+
+/* Same for the 0xCB prefixed instruction o1 */
+#define AOT_CB(at, o1, next) do { \
+	uint8_t op[3] = {0xCB, o1, 0}; \
+	int cycles; \
+	state->pc += 2; \
+	cycles = aot_cb_##o1(state, (at) + 1, &op[1], 0); \
+	handle_debug((at) + 1, state->pc, &op[1], cycles, 1); \
+	if (aot_finish(state, at, op, cycles) || state->pc != (next)) \
+		return; \
+} while (0)
+#endif
+
+#endif
@@ -0,0 +1,25 @@
+#include <stdint.h>
+
+#include "apu.h"
+#include "sched.h"
+
+/* Cycles per step of the 512 Hz frame sequencer */
+#define FRAME_SEQ_CYCLES 8192
+
+/*
+ * The sound channels are not emulated yet. The APU only runs its
+ * frame sequencer, which steps the length counters, envelopes and
+ * sweep, on its own clock: apu_mark is the cycle it last stepped at
+ * and apu_next the cycle of its next step.
+ */
+uint64_t apu_mark = 0;
+uint64_t apu_next = FRAME_SEQ_CYCLES;
+uint8_t frame_step = 0;
+
+void apu_sync() {
+	uint64_t steps = (cycle_count - apu_mark) / FRAME_SEQ_CYCLES;
+
+	frame_step = (frame_step + steps) & 7;
+	apu_mark += steps * FRAME_SEQ_CYCLES;
+	apu_next = apu_mark + FRAME_SEQ_CYCLES;
+}
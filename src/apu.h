@@ -0,0 +1,10 @@
+#ifndef APU_H
+#define APU_H
+
+#include <stdint.h>
+
+extern uint64_t apu_next;
+
+void apu_sync();
+
+#endif
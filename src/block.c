@@ -0,0 +1,515 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "block.h"
+#include "mem.h"
+#include "jit.h"
+
+#define BANK_SIZE 0x4000
+
+uint8_t block_exit = 0;
+uint8_t code_refs[0x10000];
+/* Bytes with code_refs set in each page */
+uint16_t page_code[0x100];
+
+/*
+ * Blocks are looked up by start address. ROM bank 0 has one map and
+ * every switchable ROM bank gets its own map the first time it is
+ * selected, so switching banks only swaps cur_bank.
+ */
+struct block *rom0_blocks[BANK_SIZE];
+struct block **bank_blocks[0x100];
+struct block **cur_bank = NULL;
+struct block *wram_blocks[0x2000];
+struct block *hram_blocks[0x7F];
+
+/* Instruction lengths, 0 for opcodes that do not exist */
+const uint8_t op_length[0x100] = {
+	1, 3, 1, 1, 1, 1, 2, 1, 3, 1, 1, 1, 1, 1, 2, 1,
+	2, 3, 1, 1, 1, 1, 2, 1, 2, 1, 1, 1, 1, 1, 2, 1,
+	2, 3, 1, 1, 1, 1, 2, 1, 2, 1, 1, 1, 1, 1, 2, 1,
+	2, 3, 1, 1, 1, 1, 2, 1, 2, 1, 1, 1, 1, 1, 2, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 3, 3, 3, 1, 2, 1, 1, 1, 3, 2, 3, 3, 2, 1,
+	1, 1, 3, 0, 3, 1, 2, 1, 1, 1, 3, 0, 3, 0, 2, 1,
+	2, 1, 1, 0, 0, 1, 2, 1, 2, 1, 3, 0, 0, 0, 2, 1,
+	2, 1, 1, 1, 0, 1, 2, 1, 2, 1, 3, 1, 0, 0, 2, 1,
+};
+
+/*
+ * Jumps, calls, returns, restarts, HALT and STOP end a block.
+ */
+int ends_block(uint8_t op) {
+	switch (op) {
+		case 0x10: case 0x18: case 0x20: case 0x28: case 0x30: case 0x38:
+		case 0x76:
+		case 0xC0: case 0xC2: case 0xC3: case 0xC4: case 0xC7: case 0xC8:
+		case 0xC9: case 0xCA: case 0xCC: case 0xCD: case 0xCF:
+		case 0xD0: case 0xD2: case 0xD4: case 0xD7: case 0xD8: case 0xD9:
+		case 0xDA: case 0xDC: case 0xDF:
+		case 0xE7: case 0xE9: case 0xEF: case 0xF7: case 0xFF:
+			return 1;
+	}
+	return 0;
+}
+
+/* Registers tracked by idle_loop, FZ stands for the Z, N and H flags */
+#define R_B 0x001
+#define R_C 0x002
+#define R_D 0x004
+#define R_E 0x008
+#define R_H 0x010
+#define R_L 0x020
+#define R_A 0x080
+#define R_FZ 0x100
+#define R_FC 0x200
+
+/* Registers of the r field of an opcode, 6 is (HL) */
+const uint16_t r_field[8] = {R_B, R_C, R_D, R_E, R_H, R_L, R_H | R_L, R_A};
+
+/*
+ * Returns the cycles of u if it may be part of an idle loop and the
+ * registers it reads and writes. Only register loads, loads of A from
+ * memory, 8-bit ALU operations, CPL and BIT are allowed. Reads of DIV
+ * and TIMA are not since they change without any event.
+ * Returns 0 for anything else.
+ */
+int idle_op(struct uop *u, uint16_t *reads, uint16_t *writes) {
+	uint8_t op = u->op[0];
+	uint8_t x = (op >> 3) & 7, y = op & 7;
+	uint16_t nn = ((uint16_t)u->op[2] << 8) | u->op[1];
+	*reads = 0;
+	*writes = 0;
+	if (op >= 0x40 && op < 0x80) {
+		// LD r,r' and LD r,(HL)
+		if (x == 6)
+			return 0;
+		*reads = r_field[y];
+		*writes = r_field[x];
+		return y == 6 ? 8 : 4;
+	}
+	if ((op >= 0x80 && op < 0xC0) || (op & 0xC7) == 0xC6) {
+		// ADD, ADC, SUB, SBC, AND, XOR, OR and CP with r, (HL) or n
+		*reads = R_A | (op < 0xC0 ? r_field[y] : 0);
+		if (x == 1 || x == 3)
+			*reads |= R_FC;
+		*writes = R_FZ | R_FC | (x != 7 ? R_A : 0);
+		return op >= 0xC0 || y == 6 ? 8 : 4;
+	}
+	if ((op & 0xC7) == 0x06 && x != 6) {
+		*writes = r_field[x];
+		return 8;
+	}
+	if (((op & 0xC7) == 0x04 || (op & 0xC7) == 0x05) && x != 6) {
+		// INC r and DEC r keep the carry
+		*reads = r_field[x] | R_FC;
+		*writes = r_field[x] | R_FZ;
+		return 4;
+	}
+	switch (op) {
+		case 0x00:
+			return 4;
+		case 0x0A:
+			*reads = R_B | R_C;
+			*writes = R_A;
+			return 8;
+		case 0x1A:
+			*reads = R_D | R_E;
+			*writes = R_A;
+			return 8;
+		case 0x2F:
+			*reads = R_A | R_FC;
+			*writes = R_A | R_FZ;
+			return 4;
+		case 0xF0:
+			if (u->op[1] == (DIV & 0xFF) || u->op[1] == (TIMA & 0xFF))
+				return 0;
+			*writes = R_A;
+			return 12;
+		case 0xF2:
+			*reads = R_C;
+			*writes = R_A;
+			return 8;
+		case 0xFA:
+			if (nn == DIV || nn == TIMA)
+				return 0;
+			*writes = R_A;
+			return 16;
+		case 0xCB:
+			// BIT b,r and BIT b,(HL)
+			if ((u->op[1] & 0xC0) != 0x40)
+				return 0;
+			*reads = r_field[u->op[1] & 7] | R_FC;
+			*writes = R_FZ;
+			return (u->op[1] & 7) == 6 ? 12 : 8;
+	}
+	return 0;
+}
+
+/*
+ * Returns the cycles of the last instruction of b if it is a jump
+ * back to the start of b when taken, or 0 if it is not.
+ */
+int loops_back(struct block *b) {
+	struct uop *u = &b->uops[b->count - 1];
+	uint16_t addr = b->pc;
+	int i;
+
+	for (i = 0; i < b->count - 1; i++)
+		addr += b->uops[i].len;
+	switch (u->op[0]) {
+		case 0x18: case 0x20: case 0x28: case 0x30: case 0x38:
+			return (uint16_t)(addr + 2 + (int8_t)u->op[1]) == b->pc ? 12 : 0;
+		case 0xC2: case 0xC3: case 0xCA: case 0xD2: case 0xDA:
+			return (((uint16_t)u->op[2] << 8) | u->op[1]) == b->pc ? 16 : 0;
+	}
+	return 0;
+}
+
+/*
+ * Checks if b is an idle loop: its last instruction branches back to
+ * its start and every iteration leaves the registers the same given
+ * the same memory, so it can only end once memory it reads changes.
+ * That holds when the loop does not write memory and every register
+ * it changes is set in the iteration before it is read.
+ * Fills cycles with the cycles of each instruction when the branch is
+ * taken and returns the cycles of an iteration, or 0 if b is not one.
+ */
+int idle_loop(struct block *b, uint8_t *cycles) {
+	uint16_t reads, writes;
+	uint16_t written = 0, set = 0;
+	int i, total = 0;
+
+	cycles[b->count - 1] = loops_back(b);
+	if (!cycles[b->count - 1])
+		return 0;
+
+	for (i = 0; i < b->count - 1; i++) {
+		cycles[i] = idle_op(&b->uops[i], &reads, &writes);
+		if (!cycles[i])
+			return 0;
+		written |= writes;
+	}
+	for (i = 0; i < b->count - 1; i++) {
+		idle_op(&b->uops[i], &reads, &writes);
+		if (reads & written & ~set)
+			return 0;
+		set |= writes;
+		total += cycles[i];
+	}
+	return total + cycles[b->count - 1];
+}
+
+/* What A holds while copy_loop walks an iteration */
+enum copy_a {A_START, A_LOADED, A_IMM, A_OTHER};
+
+/*
+ * Checks if b is a copy or fill loop: an iteration stores one byte
+ * through a register pair, the byte being A, a constant or loaded
+ * through a register pair, moves the pairs by INC rr, DEC rr, LD A,(HL+)
+ * and friends and then branches back while a counter is not zero. The
+ * counter is a register decremented by DEC r or a pair decremented by
+ * DEC rr and tested by LD A,r and OR r'. Every other register the loop
+ * writes has to be set in the iteration before it is read, so only the
+ * pairs and the counter carry over from one iteration to the next.
+ * Fills c and returns the cycles of an iteration, or 0 if b is not one.
+ */
+int copy_loop(struct block *b, struct copy_loop *c) {
+	int n = b->count - 1;
+	int i, p, total = 0;
+	int a = A_START, a_half = -1;
+	int zero = -1, zero_at = 0, counter = -1, stores = 0;
+	int step[3] = {0, 0, 0};
+
+	memset(c, 0, sizeof(*c));
+	c->src = -1;
+	c->dst = -1;
+	if (b->uops[n].op[0] != 0x20 && b->uops[n].op[0] != 0xC2)
+		return 0;
+	c->cycles[n] = loops_back(b);
+	if (!c->cycles[n])
+		return 0;
+
+	for (i = 0; i < n; i++) {
+		uint8_t op = b->uops[i].op[0];
+		uint8_t x = (op >> 3) & 7, y = op & 7;
+		// pair of the LD A,(rr), LD (rr),A, INC rr and DEC rr opcodes
+		p = op < 0x30 ? op >> 4 : 2;
+		switch (op) {
+			case 0x0A: case 0x1A: case 0x2A: case 0x3A: case 0x7E:
+				// LD A,(BC), LD A,(DE), LD A,(HL+), LD A,(HL-) and LD A,(HL)
+				if (c->src >= 0)
+					return 0;
+				c->src = p;
+				c->src_off = step[c->src];
+				step[2] += op == 0x2A ? 1 : op == 0x3A ? -1 : 0;
+				a = A_LOADED;
+				c->cycles[i] = 8;
+				break;
+			case 0x02: case 0x12: case 0x22: case 0x32: case 0x77: case 0x36:
+				// LD (BC),A, LD (DE),A, LD (HL+),A, LD (HL-),A, LD (HL),A and LD (HL),n
+				if (stores++)
+					return 0;
+				if (op == 0x36) {
+					c->from = COPY_IMM;
+					c->val = b->uops[i].op[1];
+				} else if (a == A_START) {
+					c->from = COPY_A;
+				} else if (a == A_LOADED) {
+					c->from = COPY_MEM;
+				} else if (a == A_IMM) {
+					c->from = COPY_IMM;
+				} else {
+					return 0;
+				}
+				c->dst = p;
+				c->dst_off = step[c->dst];
+				step[2] += op == 0x22 ? 1 : op == 0x32 ? -1 : 0;
+				c->cycles[i] = op == 0x36 ? 12 : 8;
+				break;
+			case 0x03: case 0x13: case 0x23:
+				step[p]++;
+				c->cycles[i] = 8;
+				break;
+			case 0x0B: case 0x1B: case 0x2B:
+				step[p]--;
+				c->cycles[i] = 8;
+				break;
+			case 0x3E:
+				a = A_IMM;
+				c->val = b->uops[i].op[1];
+				c->cycles[i] = 8;
+				break;
+			case 0xAF:
+				a = A_IMM;
+				c->val = 0;
+				zero = -1;
+				c->cycles[i] = 4;
+				break;
+			case 0x78: case 0x79: case 0x7A: case 0x7B: case 0x7C: case 0x7D:
+				a = A_OTHER;
+				a_half = y;
+				c->cycles[i] = 4;
+				break;
+			case 0xB0: case 0xB1: case 0xB2: case 0xB3: case 0xB4: case 0xB5:
+				// OR with the other half of the pair loaded into A
+				if (a != A_OTHER || a_half < 0 || (a_half ^ y) != 1)
+					return 0;
+				zero = COPY_PAIR + (y >> 1);
+				zero_at = step[y >> 1];
+				c->cycles[i] = 4;
+				break;
+			case 0x05: case 0x0D: case 0x15: case 0x1D: case 0x25: case 0x2D:
+				if (counter >= 0)
+					return 0;
+				counter = x;
+				zero = x;
+				c->cycles[i] = 4;
+				break;
+			default:
+				return 0;
+		}
+		if (op < 0x78 || op > 0x7D)
+			a_half = -1;
+	}
+
+	if (!stores || zero < 0)
+		return 0;
+	if (c->from == COPY_A && a != A_START)
+		return 0;
+	if (zero < COPY_PAIR) {
+		// DEC r is the only write to a register outside the pairs
+		p = zero >> 1;
+		if (p == c->src || p == c->dst || step[p])
+			return 0;
+	} else {
+		// the pair is tested once it was decremented for the iteration
+		p = zero - COPY_PAIR;
+		if (counter >= 0 || p == c->src || p == c->dst
+			|| step[p] != -1 || zero_at != -1)
+			return 0;
+	}
+	if (c->from == COPY_MEM && c->src < 0)
+		return 0;
+	c->counter = zero;
+	for (i = 0; i < 3; i++)
+		c->step[i] = step[i];
+	for (i = 0; i <= n; i++)
+		total += c->cycles[i];
+	return total;
+}
+
+/*
+ * Returns the map slot for a block starting at addr and the end of
+ * the memory region it has to stay within, or NULL if code at addr
+ * is not cached (VRAM, external RAM, echo RAM, OAM and I/O).
+ */
+struct block **block_slot(uint16_t addr, uint32_t *end) {
+	if (addr < 0x4000) {
+		*end = 0x4000;
+		return &rom0_blocks[addr];
+	}
+	if (addr < 0x8000) {
+		*end = 0x8000;
+		return &cur_bank[addr - 0x4000];
+	}
+	if (addr >= INTERNAL_RAM0 && addr < ECHO_RAM) {
+		*end = ECHO_RAM;
+		return &wram_blocks[addr - INTERNAL_RAM0];
+	}
+	if (addr >= INTERNAL_RAM1 && addr < IE) {
+		*end = IE;
+		return &hram_blocks[addr - INTERNAL_RAM1];
+	}
+	return NULL;
+}
+
+void select_block_bank(uint8_t bank) {
+	if (!bank_blocks[bank])
+		bank_blocks[bank] = calloc(BANK_SIZE, sizeof(struct block *));
+	cur_bank = bank_blocks[bank];
+	block_exit = 1;
+}
+
+/*
+ * Counts a byte of cached code in or out of code_refs. Writes to a
+ * page go through set_mem, which drops stale blocks, while any byte
+ * of it holds code.
+ */
+void ref_byte(uint16_t addr, int d) {
+	uint8_t page = addr >> 8;
+	if (d > 0 && !code_refs[addr]++ && !page_code[page]++)
+		watch_writes(page, 1);
+	else if (d < 0 && !--code_refs[addr] && !--page_code[page])
+		watch_writes(page, 0);
+}
+
+void ref_code(struct block *b, int d) {
+	uint16_t addr = b->pc;
+	int i;
+	if (addr < 0x8000)
+		return;
+	for (i = 0; i < b->count; i++) {
+		int j;
+		for (j = 0; j < b->uops[i].len; j++)
+			ref_byte(addr++, d);
+	}
+}
+
+/*
+ * Decodes the block starting at pc. Returns NULL if pc is not in
+ * cached memory or its first instruction does not fit in the region.
+ */
+struct block *decode_block(uint16_t pc) {
+	struct uop uops[MAX_BLOCK_OPS];
+	uint8_t idle_cycles[MAX_BLOCK_OPS];
+	struct copy_loop copy;
+	uint32_t end, addr = pc;
+	struct block **slot = block_slot(pc, &end);
+	int count = 0;
+	if (!slot)
+		return NULL;
+
+	while (count < MAX_BLOCK_OPS) {
+		uint8_t op = get_mem(addr);
+		uint8_t len = op_length[op];
+		if (!len || addr + len > end)
+			break;
+		struct uop *u = &uops[count++];
+		u->op[0] = op;
+		u->op[1] = len > 1 ? get_mem(addr + 1) : 0;
+		u->op[2] = len > 2 ? get_mem(addr + 2) : 0;
+		u->len = len;
+		addr += len;
+		if (ends_block(op))
+			break;
+	}
+	if (!count)
+		return NULL;
+
+	struct block *b = malloc(sizeof(struct block) + count * sizeof(struct uop));
+	b->pc = pc;
+	b->count = count;
+	b->hits = 0;
+	b->native = NULL;
+	memcpy(b->uops, uops, count * sizeof(struct uop));
+	b->idle = idle_loop(b, idle_cycles);
+	b->copy = copy_loop(b, &copy);
+	*slot = b;
+	ref_code(b, 1);
+	return b;
+}
+
+struct block *get_block(uint16_t pc) {
+	uint32_t end;
+	struct block **slot = block_slot(pc, &end);
+	if (!slot)
+		return NULL;
+	if (*slot)
+		return *slot;
+	return decode_block(pc);
+}
+
+/*
+ * Drops every WRAM/HRAM block that covers addr. Called by set_mem
+ * when code_refs shows that addr is part of a cached block.
+ */
+void invalidate_code(uint16_t addr) {
+	uint32_t end;
+	int start = addr - MAX_BLOCK_BYTES + 1;
+	int a;
+	if (start < 0)
+		start = 0;
+	for (a = start; a <= addr; a++) {
+		struct block **slot = block_slot(a, &end);
+		if (!slot || !*slot)
+			continue;
+		struct block *b = *slot;
+		uint32_t b_end = b->pc;
+		int i;
+		for (i = 0; i < b->count; i++)
+			b_end += b->uops[i].len;
+		if (addr < b_end) {
+			ref_code(b, -1);
+			free(b);
+			*slot = NULL;
+		}
+	}
+	block_exit = 1;
+}
+
+void free_map(struct block **map, int size) {
+	int i;
+	for (i = 0; i < size; i++) {
+		free(map[i]);
+		map[i] = NULL;
+	}
+}
+
+void flush_blocks() {
+	int i;
+	free_map(rom0_blocks, BANK_SIZE);
+	free_map(wram_blocks, 0x2000);
+	free_map(hram_blocks, 0x7F);
+	for (i = 0; i < 0x100; i++) {
+		if (bank_blocks[i])
+			free_map(bank_blocks[i], BANK_SIZE);
+	}
+	memset(code_refs, 0, sizeof(code_refs));
+	for (i = 0; i < 0x100; i++) {
+		if (page_code[i])
+			watch_writes(i, 0);
+		page_code[i] = 0;
+	}
+#ifdef JIT
+	jit_reset();
+#endif
+	select_block_bank(get_rom_bank());
+}
@@ -0,0 +1,83 @@
+#ifndef BLOCK_H
+#define BLOCK_H
+
+#include <stdint.h>
+
+#define MAX_BLOCK_OPS 32
+#define MAX_BLOCK_BYTES (MAX_BLOCK_OPS * 3)
+
+/* A pre-decoded instruction: opcode, operand bytes and length */
+struct uop {
+	uint8_t op[3];
+	uint8_t len;
+};
+
+struct native_block;
+
+/*
+ * A straight-line run of instructions starting at pc. The last one
+ * is the first instruction that may change the flow of control.
+ * hits counts the runs of the block and native is its compiled code
+ * when built with JIT. idle is the cycles of an iteration when the
+ * block is an idle loop and 0 otherwise, copy the same for copy and
+ * fill loops.
+ */
+struct block {
+	uint16_t pc;
+	uint8_t count;
+	uint16_t idle;
+	uint16_t copy;
+	uint32_t hits;
+	struct native_block *native;
+	struct uop uops[];
+};
+
+/* Where the byte a copy loop stores comes from */
+enum copy_from {COPY_MEM, COPY_A, COPY_IMM};
+
+/* Counters above 7 are the register pair counter - COPY_PAIR */
+#define COPY_PAIR 8
+
+/*
+ * A loop that stores one byte per iteration, as found by copy_loop().
+ * Register pairs are numbered BC, DE, HL and other registers by the
+ * r field of their opcodes. dst is the pair the byte is stored through
+ * and src the one it is loaded through when from is COPY_MEM. The
+ * offsets are how far the pair moved in the iteration before the
+ * access and step how far each pair moves per iteration. The loop
+ * goes on while counter, which the iteration decrements once, is not
+ * zero. cycles holds the cycles of each instruction.
+ */
+struct copy_loop {
+	uint8_t from;
+	uint8_t val;
+	int8_t src;
+	int8_t src_off;
+	int8_t dst;
+	int8_t dst_off;
+	int8_t step[3];
+	uint8_t counter;
+	uint8_t cycles[MAX_BLOCK_OPS];
+};
+
+/*
+ * Set whenever the block that is running may no longer match memory
+ * (code it covers was written or the ROM bank was switched).
+ */
+extern uint8_t block_exit;
+
+/* Number of cached blocks covering each address of WRAM and HRAM */
+extern uint8_t code_refs[0x10000];
+
+/* Length of each opcode, 0 for opcodes that do not exist */
+extern const uint8_t op_length[0x100];
+
+int ends_block(uint8_t op);
+int idle_loop(struct block *b, uint8_t *cycles);
+int copy_loop(struct block *b, struct copy_loop *c);
+struct block *get_block(uint16_t pc);
+void select_block_bank(uint8_t bank);
+void invalidate_code(uint16_t addr);
+void flush_blocks();
+
+#endif
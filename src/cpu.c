@@ -9,291 +9,405 @@
 #include "debug.h"
 #include "gpu.h"
 #include "input.h"
+#include "cpu.h"
+#include "perf.h"
+#include "block.h"
+#include "jit.h"
+#include "aot.h"
+#include "sched.h"
+#include "simd.h"
+#include "apu.h"
 
 #define CYCLES_PER_FRAME 70224
 #define SAVE_INTERVAL 1800
 
+enum cpu_core {SWITCH_CORE, THREADED_CORE, CACHED_CORE, JIT_CORE};
+
 /*
- * Registers:
- * A F (Z, N, H, C flag bits)
- * B C
- * D E
- * H L
- * SP
- * PC
+ * Kinds of flag producing operations. Each kind knows how to work out
+ * Z/N/H/C from its operands a and b, its result and a carry c (the
+ * carry in for ADC/SBC, the carry out for shifts and the untouched
+ * old carry for INC/DEC/BIT).
  */
-struct gb_state
-{
-	union {
-		uint16_t af;
-		struct {
-			union {
-				uint8_t f;
-				struct {
-					uint8_t fl : 4; // 4 least sig bits not used
-					uint8_t fc : 1; // (C) Carry
-					uint8_t fh : 1; // (H) Half Carry
-					uint8_t fn : 1; // (N) Subtract
-					uint8_t fz : 1; // (Z) Zero
-				};
-			};
-			uint8_t a;
-		};
-	};
-	union {
-		uint16_t bc;
-		struct {
-			uint8_t c;
-			uint8_t b;
-		};
-	};
-	union {
-		uint16_t de;
-		struct {
-			uint8_t e;
-			uint8_t d;
-		};
-	};
-	union {
-		uint16_t hl;
-		struct {
-			uint8_t l;
-			uint8_t h;
-		};
-	};
-	uint16_t sp;
-	uint16_t pc;
-	uint16_t ime;
-	uint8_t halt;
-	uint8_t di_flag;
-	uint8_t ei_flag;
-	uint8_t *mem;
-
-};
+enum flag_op {FLAGS_NONE, FLAGS_ADD, FLAGS_ADC, FLAGS_INC, FLAGS_SUB,
+	FLAGS_SBC, FLAGS_DEC, FLAGS_AND, FLAGS_OR, FLAGS_SHIFT, FLAGS_BIT};
 
 struct gb_state *gbs = NULL;
+enum cpu_core cpu_core = SWITCH_CORE;
 
 int save_timer = 0;
-uint16_t div_cycles;
-uint32_t timer_cycles, total_cycles;
+uint8_t cpu_stop = 0;
+uint64_t div_mark;
+uint32_t timer_cycles;
+uint64_t timer_mark;
+
+/*
+ * The helpers the handlers call are always inlined so that passing
+ * them the registers run_threaded() keeps in locals does not make it
+ * keep those in memory.
+ */
+#define HELPER inline __attribute__((always_inline))
+
+/*
+ * Flags of ADD/ADC and SUB/SBC indexed by carry << 16 | a << 8 | b
+ * and DAA results (A << 8 | F) indexed by (F & 0x70) << 4 | A.
+ * Filled by init_alu_tables() and used instead of working the flags
+ * out when built with ALU_TABLES.
+ */
+uint8_t add_flags[0x20000];
+uint8_t sub_flags[0x20000];
+uint16_t daa_table[0x800];
+
+uint8_t calc_flags(uint8_t op, uint8_t a, uint8_t b, uint8_t res, uint8_t c) {
+	uint8_t f = res ? 0 : FLAG_Z;
+	switch (op) {
+		case FLAGS_ADD:
+			if ((a & 0xF) + (b & 0xF) > 0xF)
+				f |= FLAG_H;
+			if (res < a)
+				f |= FLAG_C;
+			break;
+		case FLAGS_ADC:
+			if ((a & 0xF) + (b & 0xF) + c > 0xF)
+				f |= FLAG_H;
+			if (a + b + c > 0xFF)
+				f |= FLAG_C;
+			break;
+		case FLAGS_INC:
+			if ((a & 0xF) + (b & 0xF) > 0xF)
+				f |= FLAG_H;
+			if (c)
+				f |= FLAG_C;
+			break;
+		case FLAGS_SUB:
+			f |= FLAG_N;
+			if ((a & 0xF) < (b & 0xF))
+				f |= FLAG_H;
+			if (a < b)
+				f |= FLAG_C;
+			break;
+		case FLAGS_SBC:
+			f |= FLAG_N;
+			if ((a & 0xF) < (b & 0xF) + c)
+				f |= FLAG_H;
+			if (a < b + c)
+				f |= FLAG_C;
+			break;
+		case FLAGS_DEC:
+			f |= FLAG_N;
+			if ((a & 0xF) < (b & 0xF))
+				f |= FLAG_H;
+			if (c)
+				f |= FLAG_C;
+			break;
+		case FLAGS_AND:
+			f |= FLAG_H;
+			break;
+		case FLAGS_SHIFT:
+			if (c)
+				f |= FLAG_C;
+			break;
+		case FLAGS_BIT:
+			f |= FLAG_H;
+			if (c)
+				f |= FLAG_C;
+			break;
+	}
+	return f;
+}
+
+/*
+ * Looks the flags of op up in the tables, or returns -1 if they do
+ * not cover op.
+ */
+int table_flags(uint8_t op, uint8_t a, uint8_t b, uint8_t c) {
+	switch (op) {
+		case FLAGS_ADD:
+		case FLAGS_ADC:
+			return add_flags[c << 16 | a << 8 | b];
+		case FLAGS_SUB:
+		case FLAGS_SBC:
+			return sub_flags[c << 16 | a << 8 | b];
+		case FLAGS_INC:
+			return (add_flags[a << 8 | b] & ~FLAG_C) | (c << 4);
+		case FLAGS_DEC:
+			return (sub_flags[a << 8 | b] & ~FLAG_C) | (c << 4);
+	}
+	return -1;
+}
+
+uint8_t eval_flags(uint8_t op, uint8_t a, uint8_t b, uint8_t res, uint8_t c) {
+#ifdef ALU_TABLES
+	int f = table_flags(op, a, b, c);
+	if (f >= 0)
+		return f;
+#endif
+	return calc_flags(op, a, b, res, c);
+}
+
+/*
+ * Sets the flags for an operation of the given kind (see eval_flags).
+ * Without LAZY_FLAGS this writes F straight away.
+ */
+HELPER void defer_flags(struct gb_state *state, uint8_t op, uint8_t a, uint8_t b, uint8_t res, uint8_t c) {
+#ifdef LAZY_FLAGS
+	state->lf.op = op;
+	state->lf.a = a;
+	state->lf.b = b;
+	state->lf.res = res;
+	state->lf.c = c;
+#else
+	state->f = eval_flags(op, a, b, res, c);
+#endif
+}
+
+/*
+ * Brings F up to date. Needed before anything reads or partially
+ * writes F directly.
+ */
+HELPER void sync_flags(struct gb_state *state) {
+#ifdef LAZY_FLAGS
+	struct lazy_flags *lf = &state->lf;
+	if (lf->op != FLAGS_NONE) {
+		state->f = eval_flags(lf->op, lf->a, lf->b, lf->res, lf->c);
+		lf->op = FLAGS_NONE;
+	}
+#endif
+}
 
-void set_add16_flags(struct gb_state *state, uint16_t a, uint16_t b) {
+HELPER uint8_t flag_z(struct gb_state *state) {
+#ifdef LAZY_FLAGS
+	if (state->lf.op != FLAGS_NONE)
+		return !state->lf.res;
+#endif
+	return state->fz;
+}
+
+HELPER uint8_t flag_c(struct gb_state *state) {
+#ifdef LAZY_FLAGS
+	struct lazy_flags *lf = &state->lf;
+	if (lf->op != FLAGS_NONE)
+		return (eval_flags(lf->op, lf->a, lf->b, lf->res, lf->c) & FLAG_C) != 0;
+#endif
+	return state->fc;
+}
+
+HELPER void set_add16_flags(struct gb_state *state, uint16_t a, uint16_t b) {
+	sync_flags(state);
 	state->fn = 0;
 	state->fh = (((a & 0x0FFF) + (b & 0x0FFF)) & 0x1000) == 0x1000;
 	state->fc = ((((uint32_t)a & 0x0000FFFF) + ((uint32_t)b & 0x0000FFFF)) & 0x10000) == 0x10000;
 }
 
-void set_add8_flags(struct gb_state *state, uint8_t a, uint8_t b, int use_carry) {
-	state->fn = 0;
-	state->fz = !(uint8_t)(a + b);
-	state->fh = (((a & 0xF) + (b & 0xF)) & 0x10) == 0x10;
-	if (use_carry) {
-		state->fc = ((((uint16_t)a & 0xFF) + ((uint16_t)b & 0xFF)) & 0x100) == 0x100;
-	}
+HELPER void set_add8_flags(struct gb_state *state, uint8_t a, uint8_t b, int use_carry) {
+	if (use_carry)
+		defer_flags(state, FLAGS_ADD, a, b, a + b, 0);
+	else
+		defer_flags(state, FLAGS_INC, a, b, a + b, flag_c(state));
 }
 
 /* a - b */
-void set_sub8_flags(struct gb_state *state, uint8_t a, uint8_t b, int use_carry) {
-	state->fn = 1;
-	state->fz = a == b;
-	state->fh = ((a - b) & 0xF) > (a & 0xF);
-	if (use_carry) {
-		state->fc = a < b;
-	}
+HELPER void set_sub8_flags(struct gb_state *state, uint8_t a, uint8_t b, int use_carry) {
+	if (use_carry)
+		defer_flags(state, FLAGS_SUB, a, b, a - b, 0);
+	else
+		defer_flags(state, FLAGS_DEC, a, b, a - b, flag_c(state));
 }
 
 /*
  * Loads a literal value into an 8bit reg. Such as LD C,n.
  */
-int load8val2reg(struct gb_state *state, uint8_t *reg, uint8_t val) {
+HELPER int load8val2reg(struct gb_state *state, uint8_t *reg, uint8_t val) {
 	state->pc++;
 	*reg = val;
 	return 8;
 }
 
-void addA(struct gb_state *state, uint8_t val) {
+HELPER void addA(struct gb_state *state, uint8_t val) {
 	set_add8_flags(state, state->a, val, 1);
 	state->a += val;
 }
 
-void adc(struct gb_state *state, uint8_t val) {
-	uint16_t res = state->a + val + state->fc;
-	state->fn = 0;
-	state->fz = !(res & 0xFF);
-	state->fh = (((state->a & 0xF) + (val & 0xF) + state->fc) & 0x10) == 0x10;
-	state->fc = (res & 0x100) == 0x100;
-	state->a = res & 0xFF;
+HELPER void adc(struct gb_state *state, uint8_t val) {
+	uint8_t c = flag_c(state);
+	uint8_t res = state->a + val + c;
+	defer_flags(state, FLAGS_ADC, state->a, val, res, c);
+	state->a = res;
 }
 
 /*
  * Subtracts from register the value and the carry bit.
  * Important: set flags if subtracting the carry from the value would cause them to be set
  */
-void subc(struct gb_state *state, uint8_t val) {
-	uint8_t tmp = state->a - state->fc;
-	state->fh = ((state->a - state->fc) & 0xF) > (state->a & 0xF);
-	state->fc = state->a < state->fc;
-	uint8_t res = tmp - val;
-	state->fh |= ((tmp - val) & 0xF) > (tmp & 0xF);
-	state->fc |= tmp < val;
-	state->fn = 1;
-	state->fz = !res;
+HELPER void subc(struct gb_state *state, uint8_t val) {
+	uint8_t c = flag_c(state);
+	uint8_t res = state->a - val - c;
+	defer_flags(state, FLAGS_SBC, state->a, val, res, c);
 	state->a = res;
 }
 
-void subA(struct gb_state *state, uint8_t val) {
+HELPER void subA(struct gb_state *state, uint8_t val) {
 	set_sub8_flags(state, state->a, val, 1);
 	state->a -= val;
 }
 
-void andA(struct gb_state *state, uint8_t val) {
+HELPER void andA(struct gb_state *state, uint8_t val) {
 	state->a &= val;
-	state->fz = !state->a;
-	state->fn = 0;
-	state->fh = 1;
-	state->fc = 0;
+	defer_flags(state, FLAGS_AND, 0, 0, state->a, 0);
 }
 
-void xorA(struct gb_state *state, uint8_t val) {
+HELPER void xorA(struct gb_state *state, uint8_t val) {
 	state->a ^= val;
-	state->fz = !state->a;
-	state->fn = 0;
-	state->fh = 0;
-	state->fc = 0;
+	defer_flags(state, FLAGS_OR, 0, 0, state->a, 0);
 }
 
-void orA(struct gb_state *state, uint8_t val) {
+HELPER void orA(struct gb_state *state, uint8_t val) {
 	state->a |= val;
-	state->fz = !state->a;
-	state->fn = 0;
-	state->fh = 0;
-	state->fc = 0;
+	defer_flags(state, FLAGS_OR, 0, 0, state->a, 0);
 }
 
-void cpA(struct gb_state *state, uint8_t val) {
+HELPER void cpA(struct gb_state *state, uint8_t val) {
 	set_sub8_flags(state, state->a, val, 1);
 }
 
-void pop(struct gb_state *state, uint16_t *dest) {
-	*dest = ((uint16_t)get_mem(state->sp + 1) << 8) | get_mem(state->sp);
+HELPER void pop(struct gb_state *state, uint16_t *dest) {
+	*dest = read16(state->sp);
 	state->sp += 2;
 }
 
-void ret(struct gb_state *state, uint8_t condition) {
+HELPER void ret(struct gb_state *state, uint8_t condition) {
 	if (condition) {
 		pop(state, &state->pc);
 	}
 }
 
-void jump(struct gb_state *state, uint8_t condition, uint16_t dest) {
+HELPER void jump(struct gb_state *state, uint8_t condition, uint16_t dest) {
 	if (condition) {
 		state->pc = dest;
 	}
 }
 
-void push(struct gb_state *state, uint16_t val) {
-	set_mem(state->sp - 1, val >> 8);
-	set_mem(state->sp-2, val & 0xFF);
-	state->sp -= 2;
+/*
+ * Copies the registers and flags the handlers reach through regs.
+ */
+HELPER void copy_regs(struct gb_state *to, struct gb_state *from) {
+	to->af = from->af;
+	to->bc = from->bc;
+	to->de = from->de;
+	to->hl = from->hl;
+	to->sp = from->sp;
+	to->pc = from->pc;
+#ifdef LAZY_FLAGS
+	to->lf = from->lf;
+#endif
+}
+
+/*
+ * Writes the registers held in regs back to state before a write to
+ * addr when it goes to an I/O port or IE, the first thing outside the
+ * handlers that may look at them. Only the threaded core holds them
+ * apart from state.
+ */
+HELPER void write_back(struct gb_state *state, struct gb_state *regs, uint16_t addr) {
+	if (regs != state && addr >= IO_PORTS && (addr < INTERNAL_RAM1 || addr == IE))
+		copy_regs(state, regs);
+}
+
+/* set_mem() for the handlers */
+HELPER void write_mem(struct gb_state *state, struct gb_state *regs, uint16_t addr, uint8_t val) {
+	write_back(state, regs, addr);
+	set_mem(addr, val);
+}
+
+HELPER void push(struct gb_state *state, struct gb_state *regs, uint16_t val) {
+	write_back(state, regs, regs->sp - 2);
+	write_back(state, regs, regs->sp - 1);
+	write16(regs->sp - 2, val);
+	regs->sp -= 2;
 }
 
-void call(struct gb_state *state, uint8_t condition, uint16_t addr) {
+HELPER void call(struct gb_state *state, struct gb_state *regs, uint8_t condition, uint16_t addr) {
 	if (condition) {
-		push(state, state->pc);
-		state->pc = addr;
+		push(state, regs, regs->pc);
+		regs->pc = addr;
 	}
 }
 
-void rst(struct gb_state *state, uint16_t val) {
-	push(state, state->pc);
-	jump(state, 1, val);
+HELPER void rst(struct gb_state *state, struct gb_state *regs, uint16_t val) {
+	push(state, regs, regs->pc);
+	jump(regs, 1, val);
 }
 
 /*
  * Rotate as if the carry was the 9th bit.
  * Carry becomes bit 0 and bit 7 becomes what carry was.
  */
-void rot_right(struct gb_state *state, uint8_t *reg) {
-	uint8_t bit7 = state->fc << 7;
+HELPER void rot_right(struct gb_state *state, uint8_t *reg) {
+	uint8_t bit7 = flag_c(state) << 7;
 	uint8_t val = *reg;
-	state->fc = val & 0x01;
 	*reg = bit7 | val >> 1;
-	state->fn = 0;
-	state->fz = *reg == 0;
-	state->fh = 0;
+	defer_flags(state, FLAGS_SHIFT, 0, 0, *reg, val & 0x01);
 }
 
 /*
  * Rotate right where the 0 bit because the 7 bit and the carry
  */
-void rot_right_carry(struct gb_state *state, uint8_t *reg) {
+HELPER void rot_right_carry(struct gb_state *state, uint8_t *reg) {
 	uint8_t val = *reg;
-	state->fc = val & 0x01;
-	*reg = (state->fc << 7) | (val >> 1);
-	state->fz = *reg == 0;
-	state->fn = 0;
-	state->fh = 0;
+	*reg = (val << 7) | (val >> 1);
+	defer_flags(state, FLAGS_SHIFT, 0, 0, *reg, val & 0x01);
 }
 
-void rot_left_carry(struct gb_state *state, uint8_t *reg) {
+HELPER void rot_left_carry(struct gb_state *state, uint8_t *reg) {
 	uint8_t val = *reg;
-	state->fc = val >> 7;
-	*reg = (val << 1) | state->fc;
-	state->fz = *reg == 0;
-	state->fn = 0;
-	state->fh = 0;
+	*reg = (val << 1) | (val >> 7);
+	defer_flags(state, FLAGS_SHIFT, 0, 0, *reg, val >> 7);
 }
 
-void rot_left(struct gb_state *state, uint8_t *reg) {
+HELPER void rot_left(struct gb_state *state, uint8_t *reg) {
 	uint8_t val = *reg;
-	uint8_t bit0 = state->fc & 0x01;
-	state->fc = val >> 7;
+	uint8_t bit0 = flag_c(state);
 	*reg = (val << 1) | bit0;
-	state->fn = 0;
-	state->fz = *reg == 0;
-	state->fh = 0;
+	defer_flags(state, FLAGS_SHIFT, 0, 0, *reg, val >> 7);
 }
 
-void sra(struct gb_state *state, uint8_t *reg) {
-	uint8_t msb = *reg & 0x80;
-	rot_right(state, reg);
-	*reg = msb | (0x7F & *reg);
-	state->fz = *reg == 0;
+HELPER void sla(struct gb_state *state, uint8_t *reg) {
+	uint8_t val = *reg;
+	*reg = val << 1;
+	defer_flags(state, FLAGS_SHIFT, 0, 0, *reg, val >> 7);
+}
+
+HELPER void sra(struct gb_state *state, uint8_t *reg) {
+	uint8_t val = *reg;
+	*reg = (val & 0x80) | (val >> 1);
+	defer_flags(state, FLAGS_SHIFT, 0, 0, *reg, val & 0x01);
 }
 
-void srl(struct gb_state *state, uint8_t *reg) {
+HELPER void srl(struct gb_state *state, uint8_t *reg) {
 	uint8_t val = *reg;
-	state->fc = val * 0x1;
 	*reg = val >> 1;
-	state->fn = 0;
-	state->fh = 0;
-	state->fz = *reg == 0;
+	defer_flags(state, FLAGS_SHIFT, 0, 0, *reg, val & 0x01);
 }
 
-void swap(struct gb_state *state, uint8_t *reg) {
+HELPER void swap(struct gb_state *state, uint8_t *reg) {
 	uint8_t val = *reg;
 	*reg =  val << 4 | val >> 4;
-	state->fz = *reg == 0;
-	state->fn = 0;
-	state->fc = 0;
-	state->fh = 0;
+	defer_flags(state, FLAGS_SHIFT, 0, 0, *reg, 0);
 }
 
-void bit(struct gb_state *state, uint8_t bit, uint8_t *reg) {
-	state->fz = !((*reg >> bit) & 0x01);
-	state->fn = 0;
-	state->fh = 1;
+HELPER void bit(struct gb_state *state, uint8_t bit, uint8_t *reg) {
+	defer_flags(state, FLAGS_BIT, 0, 0, (*reg >> bit) & 0x01, flag_c(state));
 }
 
-void res(struct gb_state *state, uint8_t bit, uint8_t *reg) {
+HELPER void res(struct gb_state *state, uint8_t bit, uint8_t *reg) {
 	*reg &= ~(0x01 << bit);
 }
 
-void set(struct gb_state *state, uint8_t bit, uint8_t *reg) {
+HELPER void set(struct gb_state *state, uint8_t bit, uint8_t *reg) {
 	*reg |= (0x01 << bit);
 }
 
-void daa(struct gb_state *state) {
+HELPER void daa_calc(struct gb_state *state) {
 	int res = state->a;
 	if (state->fn) {
 		if (state->fh) {
@@ -319,6 +433,140 @@ void daa(struct gb_state *state) {
 	state->fz = !state->a;
 }
 
+HELPER void daa(struct gb_state *state) {
+	sync_flags(state);
+#ifdef ALU_TABLES
+	uint16_t r = daa_table[(state->f & 0x70) << 4 | state->a];
+	state->a = r >> 8;
+	state->f = r & 0xFF;
+#else
+	daa_calc(state);
+#endif
+}
+
+void init_alu_tables() {
+	struct gb_state tmp;
+	int i;
+	for (i = 0; i < 0x20000; i++) {
+		uint8_t c = i >> 16, a = i >> 8, b = i;
+		add_flags[i] = calc_flags(c ? FLAGS_ADC : FLAGS_ADD, a, b, a + b + c, c);
+		sub_flags[i] = calc_flags(c ? FLAGS_SBC : FLAGS_SUB, a, b, a - b - c, c);
+	}
+	for (i = 0; i < 0x800; i++) {
+		memset(&tmp, 0, sizeof(tmp));
+		tmp.a = i & 0xFF;
+		tmp.f = (i >> 4) & 0x70;
+		daa_calc(&tmp);
+		daa_table[i] = tmp.a << 8 | tmp.f;
+	}
+}
+
+/*
+ * Checks every input the tables cover against the arithmetic and
+ * prints the first one they disagree on. Returns nonzero if any.
+ */
+int check_alu_tables() {
+	static const uint8_t ops[6] = {FLAGS_ADD, FLAGS_ADC, FLAGS_INC, FLAGS_SUB, FLAGS_SBC, FLAGS_DEC};
+	struct gb_state tmp;
+	int i, k;
+	for (k = 0; k < 6; k++) {
+		for (i = 0; i < 0x20000; i++) {
+			uint8_t op = ops[k], c = i >> 16, a = i >> 8, b = i;
+			// ADD and SUB have no carry in
+			if (c && (op == FLAGS_ADD || op == FLAGS_SUB))
+				continue;
+			uint8_t res = op < FLAGS_SUB ? a + b + (op == FLAGS_ADC ? c : 0)
+				: a - b - (op == FLAGS_SBC ? c : 0);
+			uint8_t f = calc_flags(op, a, b, res, c);
+			if (table_flags(op, a, b, c) != f) {
+				printf("alu table mismatch: op %d a %02X b %02X c %d: %02X, expected %02X\n",
+					op, a, b, c, table_flags(op, a, b, c), f);
+				return 1;
+			}
+		}
+	}
+	for (i = 0; i < 0x800; i++) {
+		memset(&tmp, 0, sizeof(tmp));
+		tmp.a = i & 0xFF;
+		tmp.f = (i >> 4) & 0x70;
+		daa_calc(&tmp);
+		if (daa_table[i] != (tmp.a << 8 | tmp.f)) {
+			printf("daa table mismatch: a %02X f %02X: %04X, expected %04X\n",
+				i & 0xFF, (i >> 4) & 0x70, daa_table[i], tmp.a << 8 | tmp.f);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Times the ALU flag arithmetic against the lookup tables on the same
+ * stream of random operands, after checking the tables. Returns
+ * nonzero without timing anything if they do not match.
+ */
+volatile uint8_t alu_sink;
+
+int bench_alu() {
+	static const uint8_t ops[4] = {FLAGS_ADD, FLAGS_ADC, FLAGS_SUB, FLAGS_SBC};
+	int n = 1 << 22, i;
+	uint32_t *in = calloc(n, sizeof(uint32_t));
+	uint8_t acc = 0;
+	double t;
+
+	init_alu_tables();
+	if (check_alu_tables()) {
+		free(in);
+		return 1;
+	}
+	srand(1);
+	for (i = 0; i < n; i++)
+		in[i] = rand();
+
+	t = perf_time();
+	for (i = 0; i < n; i++) {
+		uint32_t v = in[i];
+		uint8_t op = ops[v >> 24 & 3], a = v >> 8, b = v, c = v >> 16 & 1;
+		if (op == FLAGS_ADD || op == FLAGS_SUB)
+			c = 0;
+		uint8_t res = op < FLAGS_SUB ? a + b + c : a - b - c;
+		acc ^= calc_flags(op, a, b, res, c);
+	}
+	printf("alu flags arithmetic: %.2f ns/op\n", (perf_time() - t) * 1e9 / n);
+
+	t = perf_time();
+	for (i = 0; i < n; i++) {
+		uint32_t v = in[i];
+		uint8_t op = ops[v >> 24 & 3], a = v >> 8, b = v, c = v >> 16 & 1;
+		if (op == FLAGS_ADD || op == FLAGS_SUB)
+			c = 0;
+		acc ^= op < FLAGS_SUB ? add_flags[c << 16 | a << 8 | b] : sub_flags[c << 16 | a << 8 | b];
+	}
+	printf("alu flags table: %.2f ns/op\n", (perf_time() - t) * 1e9 / n);
+
+	struct gb_state tmp;
+	memset(&tmp, 0, sizeof(tmp));
+	t = perf_time();
+	for (i = 0; i < n; i++) {
+		tmp.a = in[i];
+		tmp.f = (in[i] >> 4) & 0x70;
+		daa_calc(&tmp);
+		acc ^= tmp.a ^ tmp.f;
+	}
+	printf("daa arithmetic: %.2f ns/op\n", (perf_time() - t) * 1e9 / n);
+
+	t = perf_time();
+	for (i = 0; i < n; i++) {
+		uint16_t r = daa_table[in[i] & 0x7FF];
+		acc ^= (r >> 8) ^ r;
+	}
+	printf("daa table: %.2f ns/op\n", (perf_time() - t) * 1e9 / n);
+
+	// keeps the timed loops from being optimized away
+	alu_sink = acc;
+	free(in);
+	return 0;
+}
+
 
 void handle_debug(int start_pc, int pc, uint8_t* op, int cycles, int cb) {
 	if (debug_enabled) {
@@ -328,2466 +576,851 @@ void handle_debug(int start_pc, int pc, uint8_t* op, int cycles, int cb) {
 	}
 }
 
-int execute_cb(struct gb_state *state) {
+/*
+ * Executes the 0xCB prefixed instruction whose opcode cb_op, at PC,
+ * was fetched with the prefix. Returns number of clock cycles.
+ */
+int execute_cb(struct gb_state *state, uint8_t cb_op) {
+	struct gb_state *regs = state;
 	uint16_t pc = state->pc;
-	uint8_t op[3]; 
-	op[0] = get_mem(state->pc);
-	op[1] = get_mem(state->pc + 1);
-	op[2] = get_mem(state->pc + 2);
+	uint8_t op[3] = {cb_op, 0, 0};
 	int cycles = 8;
 	state->pc++;
 	uint8_t tmp;
 	switch (*op) {
-		case 0x00:
-			/* RLC B */
-			rot_left_carry(state, &state->b);
-			break;
-		case 0x01:
-			/* RLC C */
-			rot_left_carry(state, &state->c);
-			break;
-		case 0x02:
-			/* RLC D */
-			rot_left_carry(state, &state->d);
-			break;
-		case 0x03:
-			/* RLC E */
-			rot_left_carry(state, &state->e);
-			break;
-		case 0x04:
-			/* RLC H */
-			rot_left_carry(state, &state->h);
-			break;
-		case 0x05:
-			/* RLC L */
-			rot_left_carry(state, &state->l);
-			break;
-		case 0x06:
-			/* RLC (HL) */
-			tmp = get_mem(state->hl);
-			rot_left_carry(state, &tmp);
-			set_mem(state->hl, tmp);
-			cycles = 16;
-			break;
-		case 0x07:
-			/* RLC A */
-			rot_left_carry(state, &state->a);
-			break;
-		case 0x08:
-			/* RRC B */
-			rot_right_carry(state, &state->b);
-			break;
-		case 0x09:
-			/* RRC C */
-			rot_right_carry(state, &state->c);
-			break;
-		case 0x0A:
-			/* RRC D */
-			rot_right_carry(state, &state->d);
-			break;
-		case 0x0B:
-			/* RRC E */
-			rot_right_carry(state, &state->e);
-			break;
-		case 0x0C:
-			/* RRC H */
-			rot_right_carry(state, &state->h);
-			break;
-		case 0x0D:
-			/* RRC L */
-			rot_right_carry(state, &state->l);
-			break;
-		case 0x0E:
-			/* RRC (HL) */
-			tmp = get_mem(state->hl);
-			rot_right_carry(state, &tmp);
-			set_mem(state->hl, tmp);
-			cycles = 16;
+#define OP(n) case n:
+#define NEXT break
+#include "opcodes_cb.h"
+#undef OP
+#undef NEXT
+		default:
+			fprintf(stderr, "%04X : CB %02X instruction does not exit\n", pc, state->mem[pc]);
+			fprintf_debug_info(stdout);
+			exit(0);
+			cycles = 0;
 			break;
-		case 0x0F:
-			/* RRC A */
-			rot_right_carry(state, &state->a);
+	}
+	handle_debug(pc, state->pc, op, cycles, 1);
+	return cycles;
+}
+
+/*
+ * Applies a delayed DI or EI once the instruction after it has run
+ * and records the instruction for debugging.
+ */
+void finish_instruction(struct gb_state *state, uint16_t pc, uint8_t *op, int cycles) {
+	if (state->di_flag && op[0] != 0xF3) {
+		state->di_flag = 0;
+		state->ime = 0;
+		update_interrupts();
+	}
+	if (state->ei_flag && op[0] != 0xFB) {
+		state->ime = 1;
+		state->ei_flag = 0;
+		update_interrupts();
+	}
+	perf.instructions++;
+
+	handle_debug(pc, state->pc, op, cycles, 0);
+}
+
+/*
+ * Fetches the instruction at pc into op. Only the operand bytes
+ * op_length gives it are read and the rest of op is zeroed as in a
+ * decoded block. An instruction that lies within one page of the
+ * page table is loaded straight from its host pointer, one that
+ * starts in I/O or crosses a page boundary goes through get_mem.
+ */
+void fetch(uint16_t pc, uint8_t *op) {
+	uint8_t *page = read_page[pc >> 8];
+	uint8_t i = pc & 0xFF;
+	uint8_t len;
+	if (page && i < 0xFE) {
+		page += i;
+		op[0] = page[0];
+		len = op_length[op[0]];
+		op[1] = len > 1 ? page[1] : 0;
+		op[2] = len > 2 ? page[2] : 0;
+		return;
+	}
+	op[0] = get_mem(pc);
+	len = op_length[op[0]];
+	op[1] = len > 1 ? get_mem(pc + 1) : 0;
+	op[2] = len > 2 ? get_mem(pc + 2) : 0;
+}
+
+/*
+ * Executes operation in memory at PC. Updates PC reference.
+ * Returns number of clock cycles.
+ */
+int execute(struct gb_state *state) {
+	struct gb_state *regs = state;
+	uint16_t pc = state->pc;
+	uint8_t op[3];
+	fetch(pc, op);
+	uint16_t nn = ((uint16_t)op[2] << 8) | op[1];
+	state->pc++;
+	int cycles = 4;
+	uint8_t tmp;
+	switch (*op) {
+#define OP(n) case n:
+#define NEXT break
+#define CB_PREFIX cycles = execute_cb(state, op[1])
+#include "opcodes.h"
+#undef OP
+#undef NEXT
+#undef CB_PREFIX
+		default:
+			fprintf(stderr, "%04X : %02X does not exist\n", pc, op[0]);
+			exit(0);
+			cycles = 0;
 			break;
+	};
+	finish_instruction(state, pc, op, cycles);
+	return cycles;
+}
+
+/*
+ * Nonzero while an interrupt is requested in IF, enabled in IE and
+ * can be acted on, taken with IME set or ending a HALT. It is kept up
+ * to date whenever IF, IE, IME or the halt state change so that the
+ * CPU only has to test it after each instruction.
+ */
+uint8_t irq_pending = 0;
+
+void update_interrupts() {
+	if (gbs->ime || gbs->halt)
+		irq_pending = gb_mem[IE] & gb_mem[IF] & 0x1F;
+	else
+		irq_pending = 0;
+}
+
+/*
+ * Sets the IF bits of bits, for the GPU, the timer and the joypad.
+ */
+void request_interrupt(uint8_t bits) {
+	gb_mem[IF] |= bits;
+	update_interrupts();
+}
+
+/*
+ * Takes the pending interrupt with the highest priority, the lowest
+ * bit, if IME is set and ends a HALT either way.
+ */
+void handle_interrupts(struct gb_state *state) {
+	int i = __builtin_ctz(irq_pending);
+	if (state->ime) {
+		push(state, state, state->pc);
+		state->pc = VBLANK_ADDR + i * 8;
+		state->mem[IF] &= ~(1 << i);
+		state->ime = 0;
+	}
+	state->halt = 0;
+	update_interrupts();
+}
+
+/*
+ * Cycles per TIMA increment for the TAC clock select bits.
+ */
+uint32_t timer_rate(uint8_t tac) {
+	switch (tac & 0x03) {
+		case 0x01:
+			return 16;
 		case 0x10:
-			/* RL B */
-			rot_left(state, &state->b);
-			break;
+			return 64;
 		case 0x11:
-			/* RL C */
-			rot_left(state, &state->c);
-			break;
-		case 0x12:
-			/* RL D */
-			rot_left(state, &state->d);
-			break;
-		case 0x13:
-			/* RL E */
-			rot_left(state, &state->e);
-			break;
-		case 0x14:
-			/* RL H */
-			rot_left(state, &state->h);
-			break;
-		case 0x15:
-			/* RL L */
-			rot_left(state, &state->l);
-			break;
-		case 0x16:
-			/* RL (HL) */
-			tmp = get_mem(state->hl);
-			rot_left(state, &tmp);
-			set_mem(state->hl, tmp);
-			cycles = 16;
-			break;
-		case 0x17:
-			/* RL A */
-			rot_left(state, &state->a);
-			break;
-		case 0x18:
-			/* RR B */
-			rot_right(state, &state->b);
-			break;
-		case 0x19:
-			/* RR C */
-			rot_right(state, &state->c);
-			break;
-		case 0x1A:
-			/* RR D */
-			rot_right(state, &state->d);
-			break;
-		case 0x1B:
-			/* RR E */
-			rot_right(state, &state->e);
-			break;
-		case 0x1C:
-			/* RR H */
-			rot_right(state, &state->h);
-			break;
-		case 0x1D:
-			/* RR L */
-			rot_right(state, &state->l);
-			break;
-		case 0x1E:
-			/* RR (HL) */
-			tmp = get_mem(state->hl);
-			rot_right(state, &tmp);
-			set_mem(state->hl, tmp);
-			cycles = 16;
-			break;
-		case 0x1F:
-			/* RR A */
-			rot_right(state, &state->a);
-			break;
-		case 0x20:
-			/* SLA B */
-			rot_left(state, &state->b);
-			state->b &= 0xFE;
-			state->fz = !state->b;
-			break;
-		case 0x21:
-			/* SLA C */
-			rot_left(state, &state->c);
-			state->c &= 0xFE;
-			state->fz = !state->c;
-			break;
-		case 0x22:
-			/* SLA D */
-			rot_left(state, &state->d);
-			state->d &= 0xFE;
-			state->fz = !state->d;
-			break;
-		case 0x23:
-			/* SLA E */
-			rot_left(state, &state->e);
-			state->e &= 0xFE;
-			state->fz = !state->e;
-			break;
-		case 0x24:
-			/* SLA H */
-			rot_left(state, &state->h);
-			state->h &= 0xFE;
-			state->fz = !state->h;
-			break;
-		case 0x25:
-			/* SLA L */
-			rot_left(state, &state->l);
-			state->l &= 0xFE;
-			state->fz = !state->l;
-			break;
-		case 0x26:
-			/* SLA (HL) */
-			tmp = get_mem(state->hl);
-			rot_left(state, &tmp);
-			tmp &= 0xFE;
-			set_mem(state->hl, tmp);
-			state->fz = !tmp;
-			cycles = 16;
-			break;
-		case 0x27:
-			/* SLA A */
-			rot_left(state, &state->a);
-			state->a &= 0xFE;
-			state->fz = !state->a;
-			break;
-		case 0x28:
-			/* SRA B */
-			sra(state, &state->b);
-			break;
-		case 0x29:
-			/* SRA C */
-			sra(state, &state->c);
-			break;
-		case 0x2A:
-			/* SRA D */
-			sra(state, &state->d);
-			break;
-		case 0x2B:
-			/* SRA E */
-			sra(state, &state->e);
-			break;
-		case 0x2C:
-			/* SRA H */
-			sra(state, &state->h);
-			break;
-		case 0x2D:
-			/* SRA L */
-			sra(state, &state->l);
-			break;
-		case 0x2E:
-			/* SRA (HL) */
-			tmp = get_mem(state->hl);
-			sra(state, &tmp);
-			set_mem(state->hl, tmp);
-			cycles = 16;
-			break;
-		case 0x2F:
-			/* SRA A */
-			sra(state, &state->a);
-			break;
-		case 0x30:
-			/* SWAP B */
-			swap(state, &state->b);
-			break;
-		case 0x31:
-			/* SWAP C */
-			swap(state, &state->c);
-			break;
-		case 0x32:
-			/* SWAP D */
-			swap(state, &state->d);
-			break;
-		case 0x33:
-			/* SWAP E */
-			swap(state, &state->e);
-			break;
-		case 0x34:
-			/* SWAP H */
-			swap(state, &state->h);
-			break;
-		case 0x35:
-			/* SWAP L */
-			swap(state, &state->l);
-			break;
-		case 0x36:
-			/* SWAP (HL) */
-			tmp = get_mem(state->hl);
-			swap(state, &tmp);
-			set_mem(state->hl, tmp);
-			cycles = 16;
-			break;
-		case 0x37:
-			/* SWAP A */
-			swap(state, &state->a);
-			break;
-		case 0x38:
-			/* SRL B */
-			srl(state, &state->b);
-			break;
-		case 0x39:
-			/* SRL C */
-			srl(state, &state->c);
-			break;
-		case 0x3A:
-			/* SRL D */
-			srl(state, &state->d);
-			break;
-		case 0x3B:
-			/* SRL E */
-			srl(state, &state->e);
-			break;
-		case 0x3C:
-			/* SRL H */
-			srl(state, &state->h);
-			break;
-		case 0x3D:
-			/* SRL L */
-			srl(state, &state->l);
-			break;
-		case 0x3E:
-			/* SRL (HL) */
-			tmp = get_mem(state->hl);
-			srl(state, &tmp);
-			set_mem(state->hl, tmp);
-			cycles = 16;
-			break;
-		case 0x3F:
-			/* SRL A */
-			srl(state, &state->a);
-			break;
-		case 0x40:
-			/* BIT 0,B */
-			bit(state, 0, &state->b);
-			break;
-		case 0x41:
-			/* BIT 0,C */
-			bit(state, 0, &state->c);
-			break;
-		case 0x42:
-			/* BIT 0,D */
-			bit(state, 0, &state->d);
-			break;
-		case 0x43:
-			/* BIT 0,E */
-			bit(state, 0, &state->e);
-			break;
-		case 0x44:
-			/* BIT 0,H */
-			bit(state, 0, &state->h);
-			break;
-		case 0x45:
-			/* BIT 0,L */
-			bit(state, 0, &state->l);
-			break;
-		case 0x46:
-			/* BIT 0,(HL) */
-			tmp = get_mem(state->hl);
-			bit(state, 0, &tmp);
-			cycles = 12;
-			break;
-		case 0x47:
-			/* BIT 0,A */
-			bit(state, 0, &state->a);
-			break;
-		case 0x48:
-			/* BIT 1,B */
-			bit(state, 1, &state->b);
-			break;
-		case 0x49:
-			/* BIT 1,C */
-			bit(state, 1, &state->c);
-			break;
-		case 0x4A:
-			/* BIT 1,D */
-			bit(state, 1, &state->d);
-			break;
-		case 0x4B:
-			/* BIT 1,E */
-			bit(state, 1, &state->e);
-			break;
-		case 0x4C:
-			/* BIT 1,H */
-			bit(state, 1, &state->h);
-			break;
-		case 0x4D:
-			/* BIT 1,L */
-			bit(state, 1, &state->l);
-			break;
-		case 0x4E:
-			/* BIT 1,(HL) */
-			tmp = get_mem(state->hl);
-			bit(state, 1, &tmp);
-			cycles = 12;
-			break;
-		case 0x4F:
-			/* BIT 1,A */
-			bit(state, 1, &state->a);
-			break;
-		case 0x50:
-			/* BIT 2,B */
-			bit(state, 2, &state->b);
-			break;
-		case 0x51:
-			/* BIT 2,C */
-			bit(state, 2, &state->c);
-			break;
-		case 0x52:
-			/* BIT 2,D */
-			bit(state, 2, &state->d);
-			break;
-		case 0x53:
-			/* BIT 2,E */
-			bit(state, 2, &state->e);
-			break;
-		case 0x54:
-			/* BIT 2,H */
-			bit(state, 2, &state->h);
-			break;
-		case 0x55:
-			/* BIT 2,L */
-			bit(state, 2, &state->l);
-			break;
-		case 0x56:
-			/* BIT 2,(HL) */
-			tmp = get_mem(state->hl);
-			bit(state, 2, &tmp);
-			cycles = 12;
-			break;
-		case 0x57:
-			/* BIT 2,A */
-			bit(state, 2, &state->a);
-			break;
-		case 0x58:
-			/* BIT 3,B */
-			bit(state, 3, &state->b);
-			break;
-		case 0x59:
-			/* BIT 3,C */
-			bit(state, 3, &state->c);
-			break;
-		case 0x5A:
-			/* BIT 3,D */
-			bit(state, 3, &state->d);
-			break;
-		case 0x5B:
-			/* BIT 3,E */
-			bit(state, 3, &state->e);
-			break;
-		case 0x5C:
-			/* BIT 3,H */
-			bit(state, 3, &state->h);
-			break;
-		case 0x5D:
-			/* BIT 3,L */
-			bit(state, 3, &state->l);
-			break;
-		case 0x5E:
-			/* BIT 3,(HL) */
-			tmp = get_mem(state->hl);
-			bit(state, 3, &tmp);
-			cycles = 12;
-			break;
-		case 0x5F:
-			/* BIT 3,A */
-			bit(state, 3, &state->a);
-			break;
-		case 0x60:
-			/* BIT 4,B */
-			bit(state, 4, &state->b);
-			break;
-		case 0x61:
-			/* BIT 4,C */
-			bit(state, 4, &state->c);
-			break;
-		case 0x62:
-			/* BIT 4,D */
-			bit(state, 4, &state->d);
-			break;
-		case 0x63:
-			/* BIT 4,E */
-			bit(state, 4, &state->e);
-			break;
-		case 0x64:
-			/* BIT 4,H */
-			bit(state, 4, &state->h);
-			break;
-		case 0x65:
-			/* BIT 4,L */
-			bit(state, 4, &state->l);
-			break;
-		case 0x66:
-			/* BIT 4,(HL) */
-			tmp = get_mem(state->hl);
-			bit(state, 4, &tmp);
-			cycles = 12;
-			break;
-		case 0x67:
-			/* BIT 4,A */
-			bit(state, 4, &state->a);
-			break;
-		case 0x68:
-			/* BIT 5,B */
-			bit(state, 5, &state->b);
-			break;
-		case 0x69:
-			/* BIT 5,C */
-			bit(state, 5, &state->c);
-			break;
-		case 0x6A:
-			/* BIT 5,D */
-			bit(state, 5, &state->d);
-			break;
-		case 0x6B:
-			/* BIT 5,E */
-			bit(state, 5, &state->e);
-			break;
-		case 0x6C:
-			/* BIT 5,H */
-			bit(state, 5, &state->h);
-			break;
-		case 0x6D:
-			/* BIT 5,L */
-			bit(state, 5, &state->l);
-			break;
-		case 0x6E:
-			/* BIT 5,(HL) */
-			tmp = get_mem(state->hl);
-			bit(state, 5, &tmp);
-			cycles = 12;
-			break;
-		case 0x6F:
-			/* BIT 5,A */
-			bit(state, 5, &state->a);
-			break;
-		case 0x70:
-			/* BIT 6,B */
-			bit(state, 6, &state->b);
-			break;
-		case 0x71:
-			/* BIT 6,C */
-			bit(state, 6, &state->c);
-			break;
-		case 0x72:
-			/* BIT 6,D */
-			bit(state, 6, &state->d);
-			break;
-		case 0x73:
-			/* BIT 6,E */
-			bit(state, 6, &state->e);
-			break;
-		case 0x74:
-			/* BIT 6,H */
-			bit(state, 6, &state->h);
-			break;
-		case 0x75:
-			/* BIT 6,L */
-			bit(state, 6, &state->l);
-			break;
-		case 0x76:
-			/* BIT 6,(HL) */
-			tmp = get_mem(state->hl);
-			bit(state, 6, &tmp);
-			cycles = 12;
-			break;
-		case 0x77:
-			/* BIT 6,A */
-			bit(state, 6, &state->a);
-			break;
-		case 0x78:
-			/* BIT 7,B */
-			bit(state, 7, &state->b);
-			break;
-		case 0x79:
-			/* BIT 7,C */
-			bit(state, 7, &state->c);
-			break;
-		case 0x7A:
-			/* BIT 7,D */
-			bit(state, 7, &state->d);
-			break;
-		case 0x7B:
-			/* BIT 7,E */
-			bit(state, 7, &state->e);
-			break;
-		case 0x7C:
-			/* BIT 7,H */
-			bit(state, 7, &state->h);
-			break;
-		case 0x7D:
-			/* BIT 7,L */
-			bit(state, 7, &state->l);
-			break;
-		case 0x7E:
-			/* BIT 7,(HL) */
-			tmp = get_mem(state->hl);
-			bit(state, 7, &tmp);
-			cycles = 12;
-			break;
-		case 0x7F:
-			/* BIT 7,A */
-			bit(state, 7, &state->a);
-			break;
-		case 0x80:
-			/* RES 0,B */
-			res(state, 0, &state->b);
-			break;
-		case 0x81:
-			/* RES 0,C */
-			res(state, 0, &state->c);
-			break;
-		case 0x82:
-			/* RES 0,D */
-			res(state, 0, &state->d);
-			break;
-		case 0x83:
-			/* RES 0,E */
-			res(state, 0, &state->e);
-			break;
-		case 0x84:
-			/* RES 0,H */
-			res(state, 0, &state->h);
-			break;
-		case 0x85:
-			/* RES 0,L */
-			res(state, 0, &state->l);
-			break;
-		case 0x86:
-			/* RES 0,(HL) */
-			tmp = get_mem(state->hl);
-			res(state, 0, &tmp);
-			set_mem(state->hl, tmp);
-			cycles = 16;
-			break;
-		case 0x87:
-			/* RES 0,A */
-			res(state, 0, &state->a);
-			break;
-		case 0x88:
-			/* RES 1,B */
-			res(state, 1, &state->b);
-			break;
-		case 0x89:
-			/* RES 1,C */
-			res(state, 1, &state->c);
-			break;
-		case 0x8A:
-			/* RES 1,D */
-			res(state, 1, &state->d);
-			break;
-		case 0x8B:
-			/* RES 1,E */
-			res(state, 1, &state->e);
-			break;
-		case 0x8C:
-			/* RES 1,H */
-			res(state, 1, &state->h);
-			break;
-		case 0x8D:
-			/* RES 1,L */
-			res(state, 1, &state->l);
-			break;
-		case 0x8E:
-			/* RES 1,(HL) */
-			tmp = get_mem(state->hl);
-			res(state, 1, &tmp);
-			set_mem(state->hl, tmp);
-			cycles = 16;
-			break;
-		case 0x8F:
-			/* RES 1,A */
-			res(state, 1, &state->a);
-			break;
-		case 0x90:
-			/* RES 2,B */
-			res(state, 2, &state->b);
-			break;
-		case 0x91:
-			/* RES 2,C */
-			res(state, 2, &state->c);
-			break;
-		case 0x92:
-			/* RES 2,D */
-			res(state, 2, &state->d);
-			break;
-		case 0x93:
-			/* RES 2,E */
-			res(state, 2, &state->e);
-			break;
-		case 0x94:
-			/* RES 2,H */
-			res(state, 2, &state->h);
-			break;
-		case 0x95:
-			/* RES 2,L */
-			res(state, 2, &state->l);
-			break;
-		case 0x96:
-			/* RES 2,(HL) */
-			tmp = get_mem(state->hl);
-			res(state, 2, &tmp);
-			set_mem(state->hl, tmp);
-			cycles = 16;
-			break;
-		case 0x97:
-			/* RES 2,A */
-			res(state, 2, &state->a);
-			break;
-		case 0x98:
-			/* RES 3,B */
-			res(state, 3, &state->b);
-			break;
-		case 0x99:
-			/* RES 3,C */
-			res(state, 3, &state->c);
-			break;
-		case 0x9A:
-			/* RES 3,D */
-			res(state, 3, &state->d);
-			break;
-		case 0x9B:
-			/* RES 3,E */
-			res(state, 3, &state->e);
-			break;
-		case 0x9C:
-			/* RES 3,H */
-			res(state, 3, &state->h);
-			break;
-		case 0x9D:
-			/* RES 3,L */
-			res(state, 3, &state->l);
-			break;
-		case 0x9E:
-			/* RES 3,(HL) */
-			tmp = get_mem(state->hl);
-			res(state, 3, &tmp);
-			set_mem(state->hl, tmp);
-			cycles = 16;
-			break;
-		case 0x9F:
-			/* RES 3,A */
-			res(state, 3, &state->a);
-			break;
-		case 0xA0:
-			/* RES 4,B */
-			res(state, 4, &state->b);
-			break;
-		case 0xA1:
-			/* RES 4,C */
-			res(state, 4, &state->c);
-			break;
-		case 0xA2:
-			/* RES 4,D */
-			res(state, 4, &state->d);
-			break;
-		case 0xA3:
-			/* RES 4,E */
-			res(state, 4, &state->e);
-			break;
-		case 0xA4:
-			/* RES 4,H */
-			res(state, 4, &state->h);
-			break;
-		case 0xA5:
-			/* RES 4,L */
-			res(state, 4, &state->l);
-			break;
-		case 0xA6:
-			/* RES 4,(HL) */
-			tmp = get_mem(state->hl);
-			res(state, 4, &tmp);
-			set_mem(state->hl, tmp);
-			cycles = 16;
-			break;
-		case 0xA7:
-			/* RES 4,A */
-			res(state, 4, &state->a);
-			break;
-		case 0xA8:
-			/* RES 5,B */
-			res(state, 5, &state->b);
-			break;
-		case 0xA9:
-			/* RES 5,C */
-			res(state, 5, &state->c);
-			break;
-		case 0xAA:
-			/* RES 5,D */
-			res(state, 5, &state->d);
-			break;
-		case 0xAB:
-			/* RES 5,E */
-			res(state, 5, &state->e);
-			break;
-		case 0xAC:
-			/* RES 5,H */
-			res(state, 5, &state->h);
-			break;
-		case 0xAD:
-			/* RES 5,L */
-			res(state, 5, &state->l);
-			break;
-		case 0xAE:
-			/* RES 5,(HL) */
-			tmp = get_mem(state->hl);
-			res(state, 5, &tmp);
-			set_mem(state->hl, tmp);
-			cycles = 16;
-			break;
-		case 0xAF:
-			/* RES 5,A */
-			res(state, 5, &state->a);
-			break;
-		case 0xB0:
-			/* RES 6,B */
-			res(state, 6, &state->b);
-			break;
-		case 0xB1:
-			/* RES 6,C */
-			res(state, 6, &state->c);
-			break;
-		case 0xB2:
-			/* RES 6,D */
-			res(state, 6, &state->d);
-			break;
-		case 0xB3:
-			/* RES 6,E */
-			res(state, 6, &state->e);
-			break;
-		case 0xB4:
-			/* RES 6,H */
-			res(state, 6, &state->h);
-			break;
-		case 0xB5:
-			/* RES 6,L */
-			res(state, 6, &state->l);
-			break;
-		case 0xB6:
-			/* RES 6,(HL) */
-			tmp = get_mem(state->hl);
-			res(state, 6, &tmp);
-			set_mem(state->hl, tmp);
-			cycles = 16;
-			break;
-		case 0xB7:
-			/* RES 6,A */
-			res(state, 6, &state->a);
-			break;
-		case 0xB8:
-			/* RES 7,B */
-			res(state, 7, &state->b);
-			break;
-		case 0xB9:
-			/* RES 7,C */
-			res(state, 7, &state->c);
-			break;
-		case 0xBA:
-			/* RES 7,D */
-			res(state, 7, &state->d);
-			break;
-		case 0xBB:
-			/* RES 7,E */
-			res(state, 7, &state->e);
-			break;
-		case 0xBC:
-			/* RES 7,H */
-			res(state, 7, &state->h);
-			break;
-		case 0xBD:
-			/* RES 7,L */
-			res(state, 7, &state->l);
-			break;
-		case 0xBE:
-			/* RES 7,(HL) */
-			tmp = get_mem(state->hl);
-			res(state, 7, &tmp);
-			set_mem(state->hl, tmp);
-			cycles = 16;
-			break;
-		case 0xBF:
-			/* RES 7,A */
-			res(state, 7, &state->a);
-			break;
-		case 0xC0:
-			/* SET 0,B */
-			set(state, 0, &state->b);
-			break;
-		case 0xC1:
-			/* SET 0,C */
-			set(state, 0, &state->c);
-			break;
-		case 0xC2:
-			/* SET 0,D */
-			set(state, 0, &state->d);
-			break;
-		case 0xC3:
-			/* SET 0,E */
-			set(state, 0, &state->e);
-			break;
-		case 0xC4:
-			/* SET 0,H */
-			set(state, 0, &state->h);
-			break;
-		case 0xC5:
-			/* SET 0,L */
-			set(state, 0, &state->l);
-			break;
-		case 0xC6:
-			/* SET 0,(HL) */
-			tmp = get_mem(state->hl);
-			set(state, 0, &tmp);
-			set_mem(state->hl, tmp);
-			cycles = 16;
-			break;
-		case 0xC7:
-			/* SET 0,A */
-			set(state, 0, &state->a);
-			break;
-		case 0xC8:
-			/* SET 1,B */
-			set(state, 1, &state->b);
-			break;
-		case 0xC9:
-			/* SET 1,C */
-			set(state, 1, &state->c);
-			break;
-		case 0xCA:
-			/* SET 1,D */
-			set(state, 1, &state->d);
-			break;
-		case 0xCB:
-			/* SET 1,E */
-			set(state, 1, &state->e);
-			break;
-		case 0xCC:
-			/* SET 1,H */
-			set(state, 1, &state->h);
-			break;
-		case 0xCD:
-			/* SET 1,L */
-			set(state, 1, &state->l);
-			break;
-		case 0xCE:
-			/* SET 1,(HL) */
-			tmp = get_mem(state->hl);
-			set(state, 1, &tmp);
-			set_mem(state->hl, tmp);
-			cycles = 16;
-			break;
-		case 0xCF:
-			/* SET 1,A */
-			set(state, 1, &state->a);
-			break;
-		case 0xD0:
-			/* SET 2,B */
-			set(state, 2, &state->b);
-			break;
-		case 0xD1:
-			/* SET 2,C */
-			set(state, 2, &state->c);
-			break;
-		case 0xD2:
-			/* SET 2,D */
-			set(state, 2, &state->d);
-			break;
-		case 0xD3:
-			/* SET 2,E */
-			set(state, 2, &state->e);
-			break;
-		case 0xD4:
-			/* SET 2,H */
-			set(state, 2, &state->h);
-			break;
-		case 0xD5:
-			/* SET 2,L */
-			set(state, 2, &state->l);
-			break;
-		case 0xD6:
-			/* SET 2,(HL) */
-			tmp = get_mem(state->hl);
-			set(state, 2, &tmp);
-			set_mem(state->hl, tmp);
-			cycles = 16;
-			break;
-		case 0xD7:
-			/* SET 2,A */
-			set(state, 2, &state->a);
-			break;
-		case 0xD8:
-			/* SET 3,B */
-			set(state, 3, &state->b);
-			break;
-		case 0xD9:
-			/* SET 3,C */
-			set(state, 3, &state->c);
-			break;
-		case 0xDA:
-			/* SET 3,D */
-			set(state, 3, &state->d);
-			break;
-		case 0xDB:
-			/* SET 3,E */
-			set(state, 3, &state->e);
-			break;
-		case 0xDC:
-			/* SET 3,H */
-			set(state, 3, &state->h);
-			break;
-		case 0xDD:
-			/* SET 3,L */
-			set(state, 3, &state->l);
-			break;
-		case 0xDE:
-			/* SET 3,(HL) */
-			tmp = get_mem(state->hl);
-			set(state, 3, &tmp);
-			set_mem(state->hl, tmp);
-			cycles = 16;
-			break;
-		case 0xDF:
-			/* SET 3,A */
-			set(state, 3, &state->a);
-			break;
-		case 0xE0:
-			/* SET 4,B */
-			set(state, 4, &state->b);
-			break;
-		case 0xE1:
-			/* SET 4,C */
-			set(state, 4, &state->c);
-			break;
-		case 0xE2:
-			/* SET 4,D */
-			set(state, 4, &state->d);
-			break;
-		case 0xE3:
-			/* SET 4,E */
-			set(state, 4, &state->e);
-			break;
-		case 0xE4:
-			/* SET 4,H */
-			set(state, 4, &state->h);
-			break;
-		case 0xE5:
-			/* SET 4,L */
-			set(state, 4, &state->l);
-			break;
-		case 0xE6:
-			/* SET 4,(HL) */
-			tmp = get_mem(state->hl);
-			set(state, 4, &tmp);
-			set_mem(state->hl, tmp);
-			cycles = 16;
-			break;
-		case 0xE7:
-			/* SET 4,A */
-			set(state, 4, &state->a);
-			break;
-		case 0xE8:
-			/* SET 5,B */
-			set(state, 5, &state->b);
-			break;
-		case 0xE9:
-			/* SET 5,C */
-			set(state, 5, &state->c);
-			break;
-		case 0xEA:
-			/* SET 5,D */
-			set(state, 5, &state->d);
-			break;
-		case 0xEB:
-			/* SET 5,E */
-			set(state, 5, &state->e);
-			break;
-		case 0xEC:
-			/* SET 5,H */
-			set(state, 5, &state->h);
-			break;
-		case 0xED:
-			/* SET 5,L */
-			set(state, 5, &state->l);
-			break;
-		case 0xEE:
-			/* SET 5,(HL) */
-			tmp = get_mem(state->hl);
-			set(state, 5, &tmp);
-			set_mem(state->hl, tmp);
-			cycles = 16;
-			break;
-		case 0xEF:
-			/* SET 5,A */
-			set(state, 5, &state->a);
-			break;
-		case 0xF0:
-			/* SET 6,B */
-			set(state, 6, &state->b);
-			break;
-		case 0xF1:
-			/* SET 6,C */
-			set(state, 6, &state->c);
-			break;
-		case 0xF2:
-			/* SET 6,D */
-			set(state, 6, &state->d);
-			break;
-		case 0xF3:
-			/* SET 6,E */
-			set(state, 6, &state->e);
-			break;
-		case 0xF4:
-			/* SET 6,H */
-			set(state, 6, &state->h);
-			break;
-		case 0xF5:
-			/* SET 6,L */
-			set(state, 6, &state->l);
-			break;
-		case 0xF6:
-			/* SET 6,(HL) */
-			tmp = get_mem(state->hl);
-			set(state, 6, &tmp);
-			set_mem(state->hl, tmp);
-			cycles = 16;
-			break;
-		case 0xF7:
-			/* SET 6,A */
-			set(state, 6, &state->a);
-			break;
-		case 0xF8:
-			/* SET 7,B */
-			set(state, 7, &state->b);
-			break;
-		case 0xF9:
-			/* SET 7,C */
-			set(state, 7, &state->c);
-			break;
-		case 0xFA:
-			/* SET 7,D */
-			set(state, 7, &state->d);
-			break;
-		case 0xFB:
-			/* SET 7,E */
-			set(state, 7, &state->e);
-			break;
-		case 0xFC:
-			/* SET 7,H */
-			set(state, 7, &state->h);
-			break;
-		case 0xFD:
-			/* SET 7,L */
-			set(state, 7, &state->l);
-			break;
-		case 0xFE:
-			/* SET 7,(HL) */
-			tmp = get_mem(state->hl);
-			set(state, 7, &tmp);
-			set_mem(state->hl, tmp);
-			cycles = 16;
-			break;
-		case 0xFF:
-			/* SET 7,A */
-			set(state, 7, &state->a);
-			break;
-		default:
-			fprintf(stderr, "%04X : CB %02X instruction does not exit\n", pc, state->mem[pc]);
-			fprintf_debug_info(stdout);
-			exit(0);
-			cycles = 0;
-			break;
-	}
-	handle_debug(pc, state->pc, op, cycles, 1);
-	return cycles;
-}
-
-/*
- * Executes operation in memory at PC. Updates PC reference.
- * Returns number of clock cycles.
- */
-int execute(struct gb_state *state) {
-	uint16_t pc = state->pc;
-	uint8_t op[3]; 
-	op[0] = get_mem(state->pc);
-	op[1] = get_mem(state->pc + 1);
-	op[2] = get_mem(state->pc + 2);
-	state->pc++;
-	int cycles = 4;
-	uint16_t nn = ((uint16_t)op[2] << 8) | op[1];
-	uint8_t tmp;
-	switch (*op) {
-		case 0x00:
-			/* NOP */
-			break;
-		case 0x01:
-			/* LD BC,nn */
-			state->c = op[1];
-			state->b = op[2];
-			cycles = 12;
-			state->pc += 2;
-			break;
-		case 0x02:
-			/* LD (BC),A */
-			set_mem(state->bc, state->a);
-			cycles = 8;
-			break;
-		case 0x03:
-			/* INC BC */
-			state->bc++;
-			cycles = 8;
-			break;
-		case 0x04:
-			/* INC B */
-			set_add8_flags(state, state->b, 1, 0);
-			state->b++;
-			break;
-		case 0x05:
-			/* DEC B */
-			set_sub8_flags(state, state->b, 1, 0);
-			state->b--;
-			break;
-		case 0x06:
-			/* LD B,n */
-			cycles = load8val2reg(state, &state->b, op[1]);
-			break;
-		case 0x07:
-			/* RLCA */
-			rot_left_carry(state, &state->a);
-			state->fz = 0;
-			break;
-		case 0x08:
-			/* LD (nn),SP */
-			set_mem(nn, (uint8_t)(state->sp & 0xFF));
-			set_mem(nn+1, (uint8_t)(state->sp >> 8));
-			state->pc += 2;
-			cycles = 20;
-			break;
-		case 0x09:
-			/* ADD HL,BC */
-			set_add16_flags(state, state->hl, state->bc);
-			state->hl += state->bc;
-			cycles = 8;
-			break;
-		case 0x0A:
-			/* LD A,(BC) */
-			state->a = get_mem(state->bc);
-			cycles = 8;
-			break;
-		case 0x0B:
-			/* DEC BC */
-			state->bc--;
-			cycles = 8;
-			break;
-		case 0x0C:
-			/* INC C */
-			set_add8_flags(state, state->c++, 1, 0);
-			break;
-		case 0x0D:
-			/* DEC C */
-			set_sub8_flags(state, state->c--, 1, 0);
-			break;
-		case 0x0E:
-			/* LD C,n */
-			cycles = load8val2reg(state, &state->c, op[1]);
-			break;
-		case 0x0F:
-			/* RRCA */
-			rot_right_carry(state, &state->a);
-			state->fz = 0;
-			break;
-		case 0x10:
-			/* STOP 0 */
-			//fprintf(stderr, "%04X: STOP 0 not implemented\n", state->pc);
-			state->pc++;
-			break;
-		case 0x11:
-			/* LD DE,nn */
-			state->e = op[1];
-			state->d = op[2];
-			cycles = 12;
-			state->pc += 2;
-			break;
-		case 0x12:
-			/* LD (DE),A */
-			set_mem(state->de, state->a);
-			cycles = 8;
-			break;
-		case 0x13:
-			/* INC DE */
-			state->de++;
-			cycles = 8;
-			break;
-		case 0x14:
-			/* INC D */
-			set_add8_flags(state, state->d++, 1, 0);
-			break;
-		case 0x15:
-			/* DEC D */
-			set_sub8_flags(state, state->d--, 1, 0);
-			break;
-		case 0x16:
-			/* LD D,n */
-			cycles = load8val2reg(state, &state->d, op[1]);
-			break;
-		case 0x17:
-			/* RLA */
-			rot_left(state, &state->a);
-			state->fz = 0;
-			break;
-		case 0x18:
-			/* JR n */
-			state->pc += 1 + (int8_t)op[1];
-			cycles = 12;
-			break;
-		case 0x19:
-			/* ADD HL,DE */
-			set_add16_flags(state, state->hl, state->de);
-			state->hl += state->de;
-			cycles = 8;
-			break;
-		case 0x1A:
-			/* LD A,(DE) */
-			state->a = get_mem(state->de);
-			cycles = 8;
-			break;
-		case 0x1B:
-			/* DEC DE */
-			state->de--;
-			cycles = 8;
-			break;
-		case 0x1C:
-			/* INC E */
-			set_add8_flags(state, state->e++, 1, 0);
-			break;
-		case 0x1D:
-			/* DEC E */
-			set_sub8_flags(state, state->e--, 1, 0);
-			break;
-		case 0x1E:
-			/* LD E,n */
-			cycles = load8val2reg(state, &state->e, op[1]);
-			break;
-		case 0x1F:
-			/* RRA */
-			rot_right(state, &state->a);
-			state->fz = 0;
-			break;
-		case 0x20:
-			/* JR NZ,n */
-			state->pc++;
-			cycles = 8;
-			if (!state->fz) {
-				state->pc += (int8_t)op[1];
-				cycles = 12;
-			}
-			break;
-		case 0x21:
-			/* LD HL,nn */
-			state->l = op[1];
-			state->h = op[2];
-			cycles = 12;
-			state->pc += 2;
-			break;
-		case 0x22:
-			/* LD (HL+),A */
-			set_mem(state->hl++, state->a);
-			cycles = 8;
-			break;
-		case 0x23:
-			/* INC HL */
-			state->hl++;
-			cycles = 8;
-			break;
-		case 0x24:
-			/* INC H */
-			set_add8_flags(state, state->h++, 1, 0);
-			break;
-		case 0x25:
-			/* DEC H */
-			set_sub8_flags(state, state->h--, 1, 0);
-			break;
-		case 0x26:
-			/* LD H,n */
-			cycles = load8val2reg(state, &state->h, op[1]);
-			break;
-		case 0x27:
-			/* DAA */
-			daa(state);
-			break;
-		case 0x28:
-			/* JR Z,n */
-			state->pc++;
-			cycles = 8;
-			if (state->fz) {
-				state->pc += (int8_t)op[1];
-				cycles = 12;
-			}
-			break;
-		case 0x29:
-			/* ADD HL,HL */
-			set_add16_flags(state, state->hl, state->hl);
-			state->hl += state->hl;
-			cycles = 8;
-			break;
-		case 0x2A:
-			/* LD A,(HL+) */
-			state->a = get_mem(state->hl++);
-			cycles = 8;
-			break;
-		case 0x2B:
-			/* DEC HL */
-			state->hl--;
-			cycles = 8;
-			break;
-		case 0x2C:
-			/* INC L */
-			set_add8_flags(state, state->l++, 1, 0);
-			break;
-		case 0x2D:
-			/* DEC L */
-			set_sub8_flags(state, state->l--, 1, 0);
-			break;
-		case 0x2E:
-			/* LD L,n */
-			cycles = load8val2reg(state, &state->l, op[1]);
-			break;
-		case 0x2F:
-			/* CPL */
-			state->a = ~state->a;
-			state->fn = 1;
-			state->fh = 1;
-			break;
-		case 0x30:
-			/* JR NC,n */
-			state->pc++;
-			cycles = 8;
-			if (!state->fc) {
-				cycles = 12;
-				state->pc += (int8_t)op[1];
-			}
-			break;
-		case 0x31:
-			/* LD SP,nn */
-			state->sp = nn;
-			cycles = 12;
-			state->pc += 2;
-			break;
-		case 0x32:
-			/* LD (HL-),A */
-			set_mem(state->hl--, state->a);
-			cycles = 8;
-			break;
-		case 0x33:
-			/* INC SP */
-			state->sp++;
-			cycles = 8;
-			break;
-		case 0x34:
-			/* INC (HL) */
-			tmp = get_mem(state->hl);
-			set_add8_flags(state, tmp++, 1, 0);
-			set_mem(state->hl, tmp);
-			cycles = 12;
-			break;
-		case 0x35:
-			/* DEC (HL) */
-			tmp = get_mem(state->hl);
-			set_sub8_flags(state, tmp--, 1, 0);
-			set_mem(state->hl, tmp);
-			cycles = 12;
-			break;
-		case 0x36:
-			/* LD (HL),n */
-			set_mem(state->hl, op[1]);
-			state->pc++;
-			cycles = 12;
-			break;
-		case 0x37:
-			/* SCF */
-			state->fc = 1;
-			state->fn = 0;
-			state->fh = 0;
-			break;
-		case 0x38:
-			/* JR C,n */
-			state->pc++;
-			cycles = 8;
-			if (state->fc) {
-				cycles = 12;
-				state->pc += (int8_t)op[1];
-			}
-			break;
-		case 0x39:
-			/* ADD HL,SP */
-			set_add16_flags(state, state->hl, state->sp);
-			state->hl += state->sp;
-			cycles = 8;
-			break;
-		case 0x3A:
-			/* LD A,(HL-) */
-			state->a = get_mem(state->hl);
-			cycles = 8;
-			state->hl--;
-			break;
-		case 0x3B:
-			/* DEC SP */
-			state->sp--;
-			cycles = 8;
-			break;
-		case 0x3C:
-			/* INC A */
-			set_add8_flags(state, state->a++, 1, 0);
-			break;
-		case 0x3D:
-			/* DEC A */
-			set_sub8_flags(state, state->a--, 1, 0);
-			break;
-		case 0x3E:
-			/* LD A,n */
-			cycles = load8val2reg(state, &state->a, op[1]);
-			break;
-		case 0x3F:
-			/* CCF */
-			state->fc = !state->fc;
-			state->fn = 0;
-			state->fh = 0;
-			break;
-		case 0x40:
-			/* LD B,B */
-			state->b = state->b;
-			break;
-		case 0x41:
-			/* LD B,C */
-			state->b = state->c;
-			break;
-		case 0x42:
-			/* LD B,D */
-			state->b = state->d;
-			break;
-		case 0x43:
-			/* LD B,E */
-			state->b = state->e;
-			break;
-		case 0x44:
-			/* LD B,H */
-			state->b = state->h;
-			break;
-		case 0x45:
-			/* LD B,L */
-			state->b = state->l;
-			break;
-		case 0x46:
-			/* LD B,(HL) */
-			state->b = get_mem(state->hl);
-			cycles = 8;
-			break;
-		case 0x47:
-			/* LD B,A */
-			state->b = state->a;
-			break;
-		case 0x48:
-			/* LD C,B */
-			state->c = state->b;
-			break;
-		case 0x49:
-			/* LD C,C */
-			state->c = state->c;
-			break;
-		case 0x4A:
-			/* LD C,D */
-			state->c = state->d;
-			break;
-		case 0x4B:
-			/* LD C,E */
-			state->c = state->e;
-			break;
-		case 0x4C:
-			/* LD C,H */
-			state->c = state->h;
-			break;
-		case 0x4D:
-			/* LD C,L */
-			state->c = state->l;
-			break;
-		case 0x4E:
-			/* LD C,(HL) */
-			state->c = get_mem(state->hl);
-			cycles = 8;
-			break;
-		case 0x4F:
-			/* LD C,A */
-			state->c = state->a;
-			break;
-		case 0x50:
-			/* LD D,B */
-			state->d = state->b;
-			break;
-		case 0x51:
-			/* LD D,C */
-			state->d = state->c;
-			break;
-		case 0x52:
-			/* LD D,D */
-			state->d = state->d;
-			break;
-		case 0x53:
-			/* LD D,E */
-			state->d = state->e;
-			break;
-		case 0x54:
-			/* LD D,H */
-			state->d = state->h;
-			break;
-		case 0x55:
-			/* LD D,L */
-			state->d = state->l;
-			break;
-		case 0x56:
-			/* LD D,(HL) */
-			state->d = get_mem(state->hl);
-			cycles = 8;
-			break;
-		case 0x57:
-			/* LD D,A */
-			state->d = state->a;
-			break;
-		case 0x58:
-			/* LD E,B */
-			state->e = state->b;
-			break;
-		case 0x59:
-			/* LD E,C */
-			state->e = state->c;
-			break;
-		case 0x5A:
-			/* LD E,D */
-			state->e = state->d;
-			break;
-		case 0x5B:
-			/* LD E,E */
-			state->e = state->e;
-			break;
-		case 0x5C:
-			/* LD E,H */
-			state->e = state->h;
-			break;
-		case 0x5D:
-			/* LD E,L */
-			state->e = state->l;
-			break;
-		case 0x5E:
-			/* LD E,(HL) */
-			state->e = get_mem(state->hl);
-			cycles = 8;
-			break;
-		case 0x5F:
-			/* LD E,A */
-			state->e = state->a;
-			break;
-		case 0x60:
-			/* LD H,B */
-			state->h = state->b;
-			break;
-		case 0x61:
-			/* LD H,C */
-			state->h = state->c;
-			break;
-		case 0x62:
-			/* LD H,D */
-			state->h = state->d;
-			break;
-		case 0x63:
-			/* LD H,E */
-			state->h = state->e;
-			break;
-		case 0x64:
-			/* LD H,H */
-			state->h = state->h;
-			break;
-		case 0x65:
-			/* LD H,L */
-			state->h = state->l;
-			break;
-		case 0x66:
-			/* LD H,(HL) */
-			state->h = get_mem(state->hl);
-			cycles = 8;
-			break;
-		case 0x67:
-			/* LD H,A */
-			state->h = state->a;
-			break;
-		case 0x68:
-			/* LD L,B */
-			state->l = state->b;
-			break;
-		case 0x69:
-			/* LD L,C */
-			state->l = state->c;
-			break;
-		case 0x6A:
-			/* LD L,D */
-			state->l = state->d;
-			break;
-		case 0x6B:
-			/* LD L,E */
-			state->l = state->e;
-			break;
-		case 0x6C:
-			/* LD L,H */
-			state->l = state->h;
-			break;
-		case 0x6D:
-			/* LD L,L */
-			state->l = state->l;
-			break;
-		case 0x6E:
-			/* LD L,(HL) */
-			state->l = get_mem(state->hl);
-			cycles = 8;
-			break;
-		case 0x6F:
-			/* LD L,A */
-			state->l = state->a;
-			break;
-		case 0x70:
-			/* LD (HL),B */
-			set_mem(state->hl, state->b);
-			cycles = 8;
-			break;
-		case 0x71:
-			/* LD (HL),C */
-			set_mem(state->hl, state->c);
-			cycles = 8;
-			break;
-		case 0x72:
-			/* LD (HL),D */
-			set_mem(state->hl, state->d);
-			cycles = 8;
-			break;
-		case 0x73:
-			/* LD (HL),E */
-			set_mem(state->hl, state->e);
-			cycles = 8;
-			break;
-		case 0x74:
-			/* LD (HL),H */
-			set_mem(state->hl, state->h);
-			cycles = 8;
-			break;
-		case 0x75:
-			/* LD (HL),L */
-			set_mem(state->hl, state->l);
-			cycles = 8;
-			break;
-		case 0x76:
-			/* HALT */
-			state->halt = 1;
-			if (!state->ime)
-				pc++;
-			break;
-		case 0x77:
-			/* LD (HL),A */
-			set_mem(state->hl, state->a);
-			cycles = 8;
-			break;
-		case 0x78:
-			/* LD A,B */
-			state->a = state->b;
-			break;
-		case 0x79:
-			/* LD A,C */
-			state->a = state->c;
-			break;
-		case 0x7A:
-			/* LD A,D */
-			state->a = state->d;
-			break;
-		case 0x7B:
-			/* LD A,E */
-			state->a = state->e;
-			break;
-		case 0x7C:
-			/* LD A,H */
-			state->a = state->h;
-			break;
-		case 0x7D:
-			/* LD A,L */
-			state->a = state->l;
-			break;
-		case 0x7E:
-			/* LD A,(HL) */
-			state->a = get_mem(state->hl);
-			cycles = 8;
-			break;
-		case 0x7F:
-			/* LD A,A */
-			state->a = state->a;
-			break;
-		case 0x80:
-			/* ADD A,B */
-			addA(state, state->b);
-			break; 
-		case 0x81:
-			/* ADD A,C */
-			addA(state, state->c);
-			break; 
-		case 0x82:
-			/* ADD A,D */
-			addA(state, state->d);
-			break; 
-		case 0x83:
-			/* ADD A,E */
-			addA(state, state->e);
-			break; 
-		case 0x84:
-			/* ADD A,H */
-			addA(state, state->h);
-			break; 
-		case 0x85:
-			/* ADD A,L */
-			addA(state, state->l);
-			break; 
-		case 0x86:
-			/* ADD A,(HL) */
-			addA(state, get_mem(state->hl));
-			cycles = 8;
-			break; 
-		case 0x87:
-			/* ADD A,A */
-			addA(state, state->a);
-			break; 
-		case 0x88:
-			/* ADC A,B */
-			adc(state, state->b);
-			break; 
-		case 0x89:
-			/* ADC A,C */
-			adc(state, state->c);
-			break; 
-		case 0x8A:
-			/* ADC A,D */
-			adc(state, state->d);
-			break; 
-		case 0x8B:
-			/* ADC A,E */
-			adc(state, state->e);
-			break; 
-		case 0x8C:
-			/* ADC A,H */
-			adc(state, state->h);
-			break; 
-		case 0x8D:
-			/* ADC A,L */
-			adc(state, state->l);
-			break; 
-		case 0x8E:
-			/* ADC A,(HL) */
-			adc(state, get_mem(state->hl));
-			cycles = 8;
-			break; 
-		case 0x8F:
-			/* ADC A,A */
-			adc(state, state->a);
-			break; 
-		case 0x90:
-			/* SUB A,B */
-			subA(state, state->b);
-			break; 
-		case 0x91:
-			/* SUB A,C */
-			subA(state, state->c);
-			break; 
-		case 0x92:
-			/* SUB A,D */
-			subA(state, state->d);
-			break; 
-		case 0x93:
-			/* SUB A,E */
-			subA(state, state->e);
-			break; 
-		case 0x94:
-			/* SUB A,H */
-			subA(state, state->h);
-			break; 
-		case 0x95:
-			/* SUB A,L */
-			subA(state, state->l);
-			break; 
-		case 0x96:
-			/* SUB A,(HL) */
-			subA(state, get_mem(state->hl));
-			cycles = 8;
-			break; 
-		case 0x97:
-			/* SUB A,A */
-			subA(state, state->a);
-			break; 
-		case 0x98:
-			/* SBC A,B */
-			subc(state, state->b);
-			break; 
-		case 0x99:
-			/* SBC A,C */
-			subc(state, state->c);
-			break; 
-		case 0x9A:
-			/* SBC A,D */
-			subc(state, state->d);
-			break; 
-		case 0x9B:
-			/* SBC A,E */
-			subc(state, state->e);
-			break; 
-		case 0x9C:
-			/* SBC A,H */
-			subc(state, state->h);
-			break; 
-		case 0x9D:
-			/* SBC A,L */
-			subc(state, state->l);
-			break; 
-		case 0x9E:
-			/* SBC A,(HL) */
-			subc(state, get_mem(state->hl));
-			cycles = 8;
-			break; 
-		case 0x9F:
-			/* SBC A,A */
-			subc(state, state->a);
-			break;
-		case 0xA0:
-			/* AND A,B */
-			andA(state, state->b);
-			break; 
-		case 0xA1:
-			/* AND A,C */
-			andA(state, state->c);
-			break; 
-		case 0xA2:
-			/* AND A,D */
-			andA(state, state->d);
-			break; 
-		case 0xA3:
-			/* AND A,E */
-			andA(state, state->e);
-			break; 
-		case 0xA4:
-			/* AND A,H */
-			andA(state, state->h);
-			break; 
-		case 0xA5:
-			/* AND A,L */
-			andA(state, state->l);
-			break; 
-		case 0xA6:
-			/* AND A,(HL) */
-			andA(state, get_mem(state->hl));
-			cycles = 8;
-			break; 
-		case 0xA7:
-			/* AND A,A */
-			andA(state, state->a);
-			break; 
-		case 0xA8:
-			/* XOR A,B */
-			xorA(state, state->b);
-			break; 
-		case 0xA9:
-			/* XOR A,C */
-			xorA(state, state->c);
-			break; 
-		case 0xAA:
-			/* XOR A,D */
-			xorA(state, state->d);
-			break; 
-		case 0xAB:
-			/* XOR A,E */
-			xorA(state, state->e);
-			break; 
-		case 0xAC:
-			/* XOR A,H */
-			xorA(state, state->h);
-			break; 
-		case 0xAD:
-			/* XOR A,L */
-			xorA(state, state->l);
-			break; 
-		case 0xAE:
-			/* XOR A,(HL) */
-			xorA(state, get_mem(state->hl));
-			cycles = 8;
-			break; 
-		case 0xAF:
-			/* XOR A */
-			state->a = 0;
-			state->fz = 1;
-			state->fh = 0;
-			state->fn = 0;
-			state->fc = 0;
-			break;
-		case 0xB0:
-			/* OR A,B */
-			orA(state, state->b);
-			break; 
-		case 0xB1:
-			/* OR A,C */
-			orA(state, state->c);
-			break; 
-		case 0xB2:
-			/* OR A,D */
-			orA(state, state->d);
-			break; 
-		case 0xB3:
-			/* OR A,E */
-			orA(state, state->e);
-			break; 
-		case 0xB4:
-			/* OR A,H */
-			orA(state, state->h);
-			break; 
-		case 0xB5:
-			/* OR A,L */
-			orA(state, state->l);
-			break; 
-		case 0xB6:
-			/* OR A,(HL) */
-			orA(state, get_mem(state->hl));
-			cycles = 8;
-			break; 
-		case 0xB7:
-			/* OR A,A */
-			orA(state, state->a);
-			break; 
-		case 0xB8:
-			/* CP A,B */
-			cpA(state, state->b);
-			break; 
-		case 0xB9:
-			/* CP A,C */
-			cpA(state, state->c);
-			break; 
-		case 0xBA:
-			/* CP A,D */
-			cpA(state, state->d);
-			break; 
-		case 0xBB:
-			/* CP A,E */
-			cpA(state, state->e);
-			break; 
-		case 0xBC:
-			/* CP A,H */
-			cpA(state, state->h);
-			break; 
-		case 0xBD:
-			/* CP A,L */
-			cpA(state, state->l);
-			break; 
-		case 0xBE:
-			/* CP A,(HL) */
-			cpA(state, get_mem(state->hl));
-			cycles = 8;
-			break; 
-		case 0xBF:
-			/* CP A */
-			cpA(state, state->a);
-			break;
-		case 0xC0:
-			/* RET NZ */
-			cycles = !state->fz ? 20 : 8;
-			ret(state, !state->fz);
-			break;
-		case 0xC1:
-			/* POP BC */
-			pop(state, &state->bc);
-			cycles = 12;
-			break;
-		case 0xC2:
-			/* JP NZ,nn */
-			state->pc += 2;
-			jump(state, !state->fz, nn);
-			cycles = !state->fz ? 16 : 12;
-			break;
-		case 0xC3:
-			/* JP nn */
-			state->pc += 2;
-			jump(state, 1, nn);
-			cycles = 16;
-			break;
-		case 0xC4:
-			/* CALL NZ,nn */
-			state->pc += 2;
-			call(state, !state->fz, nn);
-			cycles = !state->fz ? 24 : 12;
-			break;
-		case 0xC5:
-			/* PUSH BC */
-			cycles = 16;
-			push(state, state->bc);
-			break;
-		case 0xC6:
-			/* ADD A,n */
-			cycles = 8;
-			state->pc++;
-			addA(state, op[1]);
-			break;
-		case 0xC7:
-			/* RST 0x00 */
-			cycles = 16;
-			rst(state, 0x00);
-			break;
-		case 0xC8:
-			/* RET Z */
-			ret(state, state->fz);
-			cycles = state->fz ? 20 : 8;
-			break;
-		case 0xC9:
-			/* RET */
-			ret(state, 1);
-			cycles = 16;
-			break;
-		case 0xCA:
-			/* JP Z,nn */
-			state->pc += 2;
-			jump(state, state->fz, nn);
-			cycles = state->fz ? 16 : 12;
-			break;
-		case 0xCB:
-			cycles = execute_cb(state);
-			break;
-		case 0xCC:
-			/* CALL Z,nn */
-			state->pc += 2;
-			call(state, state->fz, nn);
-			cycles = state->fz ? 24 : 12;
-			break;
-		case 0xCD:
-			/* CALL nn */
-			state->pc += 2;
-			call(state, 1, nn);
-			cycles = 24;
-			break;
-		case 0xCE:
-			/* ADC A,n */
-			state->pc++;
-			adc(state, op[1]);
-			cycles = 8;
-			break;
-		case 0xCF:
-			/* RST 0x08 */
-			cycles = 16;
-			rst(state, 0x08);
-			break;
-		case 0xD0:
-			/* RET NC */
-			ret(state, !state->fc);
-			cycles = !state->fc ? 20 : 8;
-			break;
-		case 0xD1:
-			/* POP DE */
-			pop(state, &state->de);
-			cycles = 12;
-			break;
-		case 0xD2:
-			/* JP NC,nn */
-			state->pc += 2;
-			jump(state, !state->fc, nn);
-			cycles = !state->fc ? 16 : 12;
-			break;
-		case 0xD4:
-			/* CALL NC,nn */
-			state->pc += 2;
-			call(state, !state->fc, nn);
-			cycles = !state->fc ? 24 : 12;
-			break;
-		case 0xD5:
-			/* PUSH DE */
-			cycles = 16;
-			push(state, state->de);
-			break;
-		case 0xD6:
-			/* SUB A,n */
-			cycles = 8;
-			state->pc++;
-			subA(state, op[1]);
-			break;
-		case 0xD7:
-			/* RST 0x10 */
-			cycles = 16;
-			rst(state, 0x10);
-			break;
-		case 0xD8:
-			/* RET C */
-			ret(state, state->fc);
-			cycles = state->fc ? 20 : 8;
-			break;
-		case 0xD9:
-			/* RETI */
-			ret(state, 1);
-			state->ime = 1;
-			cycles = 16;
-			break;
-		case 0xDA:
-			/* JP C,nn */
-			state->pc += 2;
-			jump(state, state->fc, nn);
-			cycles = state->fc ? 16 : 12;
-			break;
-		case 0xDC:
-			/* CALL C,nn */
-			state->pc += 2;
-			call(state, state->fc, nn);
-			cycles = state->fc ? 24 : 12;
-			break;
-		case 0xDE:
-			/* SDC A,n */
-			state->pc++;
-			subc(state, op[1]);
-			cycles = 8;
-			break;
-		case 0xDF:
-			/* RST 0x18 */
-			cycles = 16;
-			rst(state, 0x18);
-			break;
-		case 0xE0:
-			/* 
-			 * LDH (n),A
-			 * LD (n+$FF00),A
-			 */
-			set_mem(op[1] + IO_PORTS, state->a);
-			cycles = 12;
-			state->pc++;
-			break;
-		case 0xE1:
-			/* POP HL */
-			pop(state, &state->hl);
-			cycles = 12;
-			break;
-		case 0xE2:
-			/* LD (C+$FF00),A */
-			set_mem(state->c + IO_PORTS, state->a);
-			cycles = 8;
-			break;
-		case 0xE5:
-			/* PUSH HL */
-			cycles = 16;
-			push(state, state->hl);
-			break;
-		case 0xE6:
-			/* AND A,n */
-			cycles = 8;
-			state->pc++;
-			andA(state, op[1]);
-			break;
-		case 0xE7:
-			/* RST 0x20 */
-			cycles = 16;
-			rst(state, 0x20);
-			break;
-		case 0xE8:
-			/* ADD SP,n */
-			cycles = 16;
-			set_add8_flags(state, state->sp & 0xFF, op[1],1);
-			state->fz = 0;
-			state->fn = 0;
-			state->sp += (int8_t)op[1];
-			state->pc++;
-			break;
-		case 0xE9:
-			/* JP (HL) */
-			state->pc = state->hl;
-			break;
-		case 0xEA:
-			/* LD (nn),A */
-			set_mem(nn, state->a);
-			state->pc += 2;
-			cycles = 16;
-			break;
-		case 0xEE:
-			/* XOR A,n */
-			state->pc++;
-			xorA(state, op[1]);
-			cycles = 8;
-			break;
-		case 0xEF:
-			/* RST 0x28 */
-			cycles = 16;
-			rst(state, 0x28);
-			break;
-		case 0xF0:
-			/* 
-			 * LDH A,(n)
-			 * LD A,(n+$FF00)
-			 */
-			state->a = state->mem[op[1] + IO_PORTS];
-			cycles = 12;
-			state->pc++;
-			break;
-		case 0xF1:
-			/* POP AF */
-			pop(state, &state->af);
-			state->fl = 0;
-			cycles = 12;
-			break;
-		case 0xF2:
-			/* LD A,(C+$FF00) */
-			state->a = state->mem[state->c + IO_PORTS];
-			cycles = 8;
-			break;
-		case 0xF3:
-			/* DI */
-			state->di_flag = 1;
-			break;
-		case 0xF5:
-			/* PUSH AF */
-			cycles = 16;
-			state->fl = 0;
-			push(state, state->af);
-			break;
-		case 0xF6:
-			/* OR A,n */
-			cycles = 8;
-			state->pc++;
-			orA(state, op[1]);
-			break;
-		case 0xF7:
-			/* RST 0x30 */
-			cycles = 16;
-			rst(state, 0x30);
-			break;
-		case 0xF8:
-			/* LD HL,SP+n */
-			/* LDHL SP,n */
-			state->pc++;
-			set_add8_flags(state, state->sp & 0xFF, op[1],1);
-			state->fz = 0;
-			state->fn = 0;
-			state->hl = state->sp + (int8_t)op[1];
-			cycles = 12;
-			break;
-		case 0xF9:
-			/* LD SP,HL */
-			state->sp = state->hl;
-			cycles = 8;
-			break;
-		case 0xFA:
-			/* LD A,(nn) */
-			state->pc += 2;
-			state->a = get_mem(nn);
-			cycles = 16;
-			break;
-		case 0xFB:
-			/* EI */
-			state->ei_flag = 1;
-			break;
-		case 0xFE:
-			/* CP A,n */
-			state->pc++;
-			cpA(state, op[1]);
-			cycles = 8;
-			break;
-		case 0xFF:
-			/* RST 0x38 */
-			cycles = 16;
-			rst(state, 0x38);
-			break;
+			return 256;
+		case 0x00:
 		default:
-			fprintf(stderr, "%04X : %02X does not exist\n", pc, op[0]);
-			exit(0);
-			cycles = 0;
-			break;
-	};
-	if (state->di_flag && op[0] != 0xF3) {
-		state->di_flag = 0;
-		state->ime = 0;
+			return 1024;
 	}
-	if (state->ei_flag && op[0] != 0xFB) {
-		state->ime = 1;
-		state->ei_flag = 0;
+}
+
+/*
+ * DIV and TIMA are not counted per instruction. They are brought up
+ * to date from cycle_count when they are read or written, and the
+ * only time the timer has to act on its own is the TIMA overflow,
+ * which EV_TIMA is scheduled for.
+ *
+ * div_mark is the cycle DIV last stepped at. TIMA counts the cycles
+ * that pass with the timer enabled: timer_cycles had been counted
+ * towards its next increment by timer_mark.
+ */
+void sync_timers() {
+	uint64_t steps = (cycle_count - div_mark) >> 8;
+	uint32_t rate = timer_rate(gb_mem[TAC]);
+	uint64_t elapsed;
+
+	gb_mem[DIV] += steps;
+	div_mark += steps << 8;
+	if (gb_mem[TAC] & 0x04) {
+		elapsed = timer_cycles + (cycle_count - timer_mark);
+		gb_mem[TIMA] += elapsed / rate;
+		timer_cycles = elapsed % rate;
 	}
+	timer_mark = cycle_count;
+}
 
-	handle_debug(pc, state->pc, op, cycles, 0);
-	return cycles;
+/*
+ * Schedules EV_TIMA for the cycle TIMA overflows at. Called after
+ * sync_timers() and a write to DIV, TIMA or TAC.
+ */
+void timers_written() {
+	uint32_t rate = timer_rate(gb_mem[TAC]);
+	uint64_t at = timer_mark + (uint64_t)(0x100 - gb_mem[TIMA]) * rate;
+
+	if (!(gb_mem[TAC] & 0x04))
+		deschedule(EV_TIMA);
+	else if (at <= cycle_count + timer_cycles)
+		schedule(EV_TIMA, cycle_count);
+	else
+		schedule(EV_TIMA, at - timer_cycles);
 }
 
-void handle_interrupts(struct gb_state *state) {
+/*
+ * TIMA wraps to 0 and requests the timer interrupt.
+ */
+void tima_event() {
+	sync_timers();
+	request_interrupt(0x04);
+	//state->mem[TIMA] = state->mem[TMA];
+	timers_written();
+}
+
+void frame_event(struct gb_state *state) {
+	sync_all();
+	on_frame_end();
+	perf.frames++;
+	if (++save_timer == SAVE_INTERVAL) {
+		save_ram();
+		save_timer = 0;
+	}
+	schedule(EV_FRAME, cycle_count + CYCLES_PER_FRAME);
+}
+
+/*
+ * Ends run_cycles() once its budget is used up. block_exit also
+ * leaves the block being run so the cores notice before the next one.
+ */
+void budget_event() {
+	cpu_stop = 1;
+	block_exit = 1;
+	deschedule(EV_BUDGET);
+}
+
+/*
+ * Restarts DIV and TIMA counting from the current cycle.
+ */
+void reset_timers(struct gb_state *state) {
+	div_mark = cycle_count;
+	timer_cycles = 0;
+	timer_mark = cycle_count;
+	timers_written();
+}
+
+/*
+ * Runs every event that is due by cycle_count.
+ */
+void run_events(struct gb_state *state) {
+	if (event_at[EV_GPU] <= cycle_count)
+		component_event(COMP_GPU);
+	if (event_at[EV_TIMA] <= cycle_count)
+		component_event(COMP_TIMER);
+	if (event_at[EV_FRAME] <= cycle_count)
+		frame_event(state);
+	if (event_at[EV_SLICE] <= cycle_count)
+		slice_event();
+	if (event_at[EV_BUDGET] <= cycle_count)
+		budget_event();
+}
+
+/*
+ * Counts the cycles the last instruction took, runs the GPU, timer
+ * and frame events that came due and then services any pending
+ * interrupt.
+ */
+void clock_cycles(struct gb_state *state, int cycles) {
+	cycle_count += cycles;
+	if (cycle_count >= next_event)
+		run_events(state);
+	if (irq_pending)
+		handle_interrupts(state);
+}
+
+/*
+ * Returns how many cycles can pass before the cycle at.
+ */
+uint32_t cycles_until(uint64_t at) {
+	if (at <= cycle_count)
+		return 0;
+	if (at - cycle_count - 1 > UINT32_MAX)
+		return UINT32_MAX;
+	return at - cycle_count - 1;
+}
+
+/*
+ * Returns the cycle the frame or the run_cycles() budget ends at.
+ */
+uint64_t run_end() {
+	if (event_at[EV_BUDGET] < event_at[EV_FRAME])
+		return event_at[EV_BUDGET];
+	return event_at[EV_FRAME];
+}
+
+/*
+ * Returns how many cycles can be clocked before an interrupt could be
+ * taken, the frame ends or the budget runs out.
+ */
+uint32_t cycles_to_interrupt(struct gb_state *state) {
+	uint64_t at = run_end();
 	uint8_t ie = state->mem[IE];
-	uint8_t iff = state->mem[IF];
-	uint16_t addr = 0x0000;
-	uint8_t val = iff & ie;
-	uint8_t rb;
-	if (val & 0x01) {
-		// V-Blank
-		addr = VBLANK_ADDR;
-		rb = ~0x01;
-	} else if (val & 0x02) {
-		// LCDC
-		addr = LCDC_ADDR;
-		rb = ~0x02;
-	} else if (val & 0x04) {
-		// Timer overflow
-		addr = TIMER_OVERFLOW_ADDR;
-		rb = ~0x04;
-	} else if (val & 0x08) {
-		// Serial I/O transfer complete
-		addr = SERIAL_IO_TRANS_ADDR;
-		rb = ~0x08;
-	} else if (val & 0x10) {
-		// Transition from High to Low of Pin number P10-P13
-		addr = P10_P13_TRANSITION_ADDR;
-		rb = ~0x10;
+	if (!state->ime)
+		return cycles_until(at);
+	if (irq_pending)
+		return 0;
+	if ((ie & 0x03) && event_at[EV_GPU] < at)
+		at = event_at[EV_GPU];
+	if ((ie & 0x04) && event_at[EV_TIMA] < at)
+		at = event_at[EV_TIMA];
+	return cycles_until(at);
+}
+
+#ifdef AOT
+/* Set once the cartridge code runs, the bootstrap ROM is never recompiled */
+uint8_t aot_active = 0;
+
+/*
+ * Runs the recompiled block at PC. Returns 0 if there is none.
+ */
+int run_aot(struct gb_state *state) {
+	aot_fn fn = aot_block(get_rom_bank(), state->pc);
+	if (!fn)
+		return 0;
+	block_exit = 0;
+	fn(state);
+	return 1;
+}
+#endif
+
+/*
+ * Clocks a halted CPU. Nothing but an event can wake it, so the 4
+ * cycle steps before the next one are skipped in one go and only the
+ * step that reaches it is clocked normally.
+ */
+void clock_halted(struct gb_state *state) {
+	if (!irq_pending && next_event > cycle_count)
+		cycle_count += (next_event - cycle_count - 1) / 4 * 4;
+	clock_cycles(state, 4);
+}
+
+/*
+ * Returns how many cycles can be clocked before the GPU next changes
+ * mode or LY, TIMA overflows, the frame ends or the budget runs out.
+ * Apart from DIV and TIMA counting up, only those change memory the
+ * CPU can read.
+ */
+uint32_t cycles_to_event(struct gb_state *state) {
+	uint64_t at = run_end();
+	if (gpu_next_change() < at)
+		at = gpu_next_change();
+	if (event_at[EV_TIMA] < at)
+		at = event_at[EV_TIMA];
+	return cycles_until(at);
+}
+
+/*
+ * Clocks k iterations of the loop b, which run without interrupts
+ * or frame ends, as clock_cycles would have after each instruction.
+ * cycles holds the cycles of each instruction of b.
+ */
+void clock_iterations(struct gb_state *state, struct block *b, uint8_t *cycles, uint32_t k) {
+	uint32_t t, iter = 0;
+	int i;
+
+	for (i = 0; i < b->count; i++)
+		iter += cycles[i];
+	for (t = 0; t < k; t++) {
+		if (cycle_count + iter < next_event) {
+			cycle_count += iter;
+			continue;
+		}
+		for (i = 0; i < b->count; i++) {
+			cycle_count += cycles[i];
+			if (cycle_count >= next_event)
+				run_events(state);
+		}
 	}
+	perf.instructions += k * b->count;
+}
+
+/*
+ * Skips iterations of the idle loop b, which just went round once
+ * more with nothing but the CPU changing memory. The memory it reads
+ * stays the same until cycles_to_event() runs out, so every whole
+ * iteration before then is clocked in one go: the GPU and the
+ * timers catch up from cycle_count when next looked at and the
+ * registers already hold what the iterations would leave in them.
+ */
+void skip_idle(struct gb_state *state, struct block *b) {
+	uint8_t cycles[MAX_BLOCK_OPS];
+	uint32_t iter = idle_loop(b, cycles);
+	uint32_t k, i;
+	uint16_t addr = 0;
 
-	if (addr != 0x000) {
-		if (state->ime) {
-			push(state, state->pc);
-			state->pc = addr;
-			state->mem[IF] &= rb;
-			state->ime = 0;
+	if (irq_pending)
+		return;
+	// a load through a register pair may point at DIV or TIMA
+	for (i = 0; i < b->count; i++) {
+		switch (b->uops[i].op[0]) {
+			case 0x0A:
+				addr = state->bc;
+				break;
+			case 0x1A:
+				addr = state->de;
+				break;
+			case 0xF2:
+				addr = IO_PORTS | state->c;
+				break;
+			case 0x46: case 0x4E: case 0x56: case 0x5E:
+			case 0x66: case 0x6E: case 0x7E: case 0x86: case 0x8E:
+			case 0x96: case 0x9E: case 0xA6: case 0xAE: case 0xB6: case 0xBE:
+				addr = state->hl;
+				break;
+			case 0xCB:
+				if ((b->uops[i].op[1] & 7) == 6)
+					addr = state->hl;
+				break;
 		}
-		state->halt = 0;
+		if (addr == DIV || addr == TIMA)
+			return;
 	}
 
+	k = cycles_to_event(state) / iter;
+	if (!k)
+		return;
+
+	clock_iterations(state, b, cycles, k);
+	perf_idle(b->pc, k * iter);
 }
 
-void handle_timers(struct gb_state *state, uint8_t cycles) {
-	uint8_t tac = state->mem[TAC];
-	div_cycles += cycles;
-	if (div_cycles >= 256) {
-		div_cycles = 0;
-		state->mem[DIV] += 1;
-	}
-	if ((tac & 0x04) != 0x04)
+/*
+ * Runs the iterations of the copy or fill loop b, which is at its
+ * start, up to its last one as a single transfer through get_mem and
+ * set_mem and clocks them in one go. The transfer stops before
+ * anything an iteration does could behave differently from running
+ * it: an interrupt that could be taken, the frame end, a GPU event
+ * while VRAM or OAM is written, an access to I/O, a write to ROM, echo
+ * RAM or cached code. The last iteration always runs normally so the
+ * flags and A end up as if every iteration had.
+ */
+void run_copy(struct gb_state *state, struct block *b) {
+	struct copy_loop c;
+	uint32_t iter = copy_loop(b, &c);
+	uint16_t *pairs[3] = {&state->bc, &state->de, &state->hl};
+	uint8_t *counter = NULL;
+	uint8_t val = c.from == COPY_A ? state->a : c.val;
+	uint32_t n, k;
+	uint16_t src, dst;
+	uint32_t gpu = cycles_until(gpu_next_change());
+	int i;
+
+	if (debug_enabled || state->ei_flag || state->di_flag)
 		return;
-	timer_cycles += cycles;
-	uint32_t time_rate;
-	switch (tac & 0x03) {
-		case 0x01:
-			time_rate = 16;
-			break;
-		case 0x10:
-			time_rate = 64;
-			break;
-		case 0x11:
-			time_rate = 256;
-			break;
-		case 0x00:
-		default:
-			time_rate = 1024;
-			break;
+	if (c.counter < COPY_PAIR) {
+		// B, D and H are the high bytes of their pairs
+		counter = (uint8_t *)pairs[c.counter >> 1] + !(c.counter & 1);
+		n = *counter ? *counter : 0x100;
+	} else {
+		n = *pairs[c.counter - COPY_PAIR];
+		n = n ? n : 0x10000;
 	}
-	if (timer_cycles >= time_rate) {
-		timer_cycles = 0;
-		if (state->mem[TIMA] == 0xFF) {
-			state->mem[IF] |= 0x04;
-			//state->mem[TIMA] = state->mem[TMA];
+	n = n - 1;
+	if (cycles_to_interrupt(state) / iter < n)
+		n = cycles_to_interrupt(state) / iter;
+
+	for (k = 0; k < n; k++) {
+		dst = *pairs[c.dst] + c.dst_off + k * c.step[c.dst];
+		if (dst < VIDEO_RAM || (dst >= ECHO_RAM && dst < OAM)
+			|| (dst >= IO_PORTS && dst < INTERNAL_RAM1) || dst == IE || code_refs[dst])
+			break;
+		// VRAM and OAM locks change and the GPU draws from them on events
+		if ((dst < SW8_ROM_BANK || (dst >= OAM && dst < IO_PORTS))
+			&& (k + 1) * iter > gpu)
+			break;
+		if (c.from == COPY_MEM) {
+			src = *pairs[c.src] + c.src_off + k * c.step[c.src];
+			if ((src >= IO_PORTS && src < INTERNAL_RAM1) || src == IE)
+				break;
+			val = get_mem(src);
 		}
-		state->mem[TIMA] += 1;
+		set_mem(dst, val);
 	}
+	if (!k)
+		return;
+
+	for (i = 0; i < 3; i++)
+		*pairs[i] += k * c.step[i];
+	// a counter pair moves with the others
+	if (counter)
+		*counter -= k;
+	clock_iterations(state, b, c.cycles, k);
+	perf_copy(k);
+}
+
+/*
+ * Called when the idle loop b went back to its start. Skips ahead if
+ * it has run a whole iteration since it last did and nothing but the
+ * CPU could have changed memory meanwhile, so the registers hold what
+ * every further iteration leaves in them.
+ */
+void check_idle(struct gb_state *state, struct block *b) {
+	static uint16_t loop_pc;
+	static uint64_t mark;
+	static uint32_t quiet;
+
+	if (debug_enabled || state->ei_flag || state->di_flag)
+		return;
+	if (loop_pc == b->pc && perf.instructions - mark == b->count
+		&& b->idle <= quiet)
+		skip_idle(state, b);
+	loop_pc = b->pc;
+	mark = perf.instructions;
+	quiet = cycles_to_event(state);
+}
+
+/*
+ * Called after a taken branch at pc that went back at most a block.
+ * Only the last instruction of an idle, copy or fill loop branches so
+ * the branch closed the loop if it came from inside it.
+ */
+void loop_branch(struct gb_state *state, uint16_t pc) {
+	struct block *b = get_block(state->pc);
+	if (!b || pc - b->pc >= MAX_BLOCK_BYTES)
+		return;
+	if (b->idle)
+		check_idle(state, b);
+	else if (b->copy)
+		run_copy(state, b);
 }
 
 int tick(struct gb_state *state) {
-	int i, cycles = 4;
-	if (!state->halt) {
-		cycles = execute(state);
+	uint16_t pc = state->pc;
+	int cycles;
+	if (state->halt) {
+		clock_halted(state);
+		return 0;
+	}
+#ifdef AOT
+	if (aot_active && run_aot(state))
+		return 0;
+#endif
+	cycles = execute(state);
+	clock_cycles(state, cycles);
+	if (!state->halt && (uint16_t)(pc - state->pc) < MAX_BLOCK_BYTES)
+		loop_branch(state, pc);
+	return 0;
+}
+
+/*
+ * Threaded interpreter core. Runs the same handlers as execute() and
+ * execute_cb() but every handler finishes its instruction, clocks the
+ * rest of the system and jumps straight to the handler of the next
+ * opcode through op_labels instead of returning to a shared switch.
+ * Relies on the GCC labels as values extension.
+ *
+ * The registers and flags are kept in the local copy regs points at
+ * so that the compiler can hold them in host registers. They are only
+ * written back to state before something outside the handlers may
+ * look at them: a write to an I/O port or IE (see write_back()), a
+ * debug hook, an interrupt, a halt, an idle or copy loop and leaving
+ * the core. They are loaded again after whatever of those could have
+ * changed them. GCC only keeps PC and SP in host registers and the
+ * speed is within noise of pointing regs at state, so the other cores
+ * do not do this.
+ */
+void run_threaded(struct gb_state *state) {
+	static const void *op_labels[0x100] = {
+		&&op_0x00, &&op_0x01, &&op_0x02, &&op_0x03, &&op_0x04, &&op_0x05, &&op_0x06, &&op_0x07,
+		&&op_0x08, &&op_0x09, &&op_0x0A, &&op_0x0B, &&op_0x0C, &&op_0x0D, &&op_0x0E, &&op_0x0F,
+		&&op_0x10, &&op_0x11, &&op_0x12, &&op_0x13, &&op_0x14, &&op_0x15, &&op_0x16, &&op_0x17,
+		&&op_0x18, &&op_0x19, &&op_0x1A, &&op_0x1B, &&op_0x1C, &&op_0x1D, &&op_0x1E, &&op_0x1F,
+		&&op_0x20, &&op_0x21, &&op_0x22, &&op_0x23, &&op_0x24, &&op_0x25, &&op_0x26, &&op_0x27,
+		&&op_0x28, &&op_0x29, &&op_0x2A, &&op_0x2B, &&op_0x2C, &&op_0x2D, &&op_0x2E, &&op_0x2F,
+		&&op_0x30, &&op_0x31, &&op_0x32, &&op_0x33, &&op_0x34, &&op_0x35, &&op_0x36, &&op_0x37,
+		&&op_0x38, &&op_0x39, &&op_0x3A, &&op_0x3B, &&op_0x3C, &&op_0x3D, &&op_0x3E, &&op_0x3F,
+		&&op_0x40, &&op_0x41, &&op_0x42, &&op_0x43, &&op_0x44, &&op_0x45, &&op_0x46, &&op_0x47,
+		&&op_0x48, &&op_0x49, &&op_0x4A, &&op_0x4B, &&op_0x4C, &&op_0x4D, &&op_0x4E, &&op_0x4F,
+		&&op_0x50, &&op_0x51, &&op_0x52, &&op_0x53, &&op_0x54, &&op_0x55, &&op_0x56, &&op_0x57,
+		&&op_0x58, &&op_0x59, &&op_0x5A, &&op_0x5B, &&op_0x5C, &&op_0x5D, &&op_0x5E, &&op_0x5F,
+		&&op_0x60, &&op_0x61, &&op_0x62, &&op_0x63, &&op_0x64, &&op_0x65, &&op_0x66, &&op_0x67,
+		&&op_0x68, &&op_0x69, &&op_0x6A, &&op_0x6B, &&op_0x6C, &&op_0x6D, &&op_0x6E, &&op_0x6F,
+		&&op_0x70, &&op_0x71, &&op_0x72, &&op_0x73, &&op_0x74, &&op_0x75, &&op_0x76, &&op_0x77,
+		&&op_0x78, &&op_0x79, &&op_0x7A, &&op_0x7B, &&op_0x7C, &&op_0x7D, &&op_0x7E, &&op_0x7F,
+		&&op_0x80, &&op_0x81, &&op_0x82, &&op_0x83, &&op_0x84, &&op_0x85, &&op_0x86, &&op_0x87,
+		&&op_0x88, &&op_0x89, &&op_0x8A, &&op_0x8B, &&op_0x8C, &&op_0x8D, &&op_0x8E, &&op_0x8F,
+		&&op_0x90, &&op_0x91, &&op_0x92, &&op_0x93, &&op_0x94, &&op_0x95, &&op_0x96, &&op_0x97,
+		&&op_0x98, &&op_0x99, &&op_0x9A, &&op_0x9B, &&op_0x9C, &&op_0x9D, &&op_0x9E, &&op_0x9F,
+		&&op_0xA0, &&op_0xA1, &&op_0xA2, &&op_0xA3, &&op_0xA4, &&op_0xA5, &&op_0xA6, &&op_0xA7,
+		&&op_0xA8, &&op_0xA9, &&op_0xAA, &&op_0xAB, &&op_0xAC, &&op_0xAD, &&op_0xAE, &&op_0xAF,
+		&&op_0xB0, &&op_0xB1, &&op_0xB2, &&op_0xB3, &&op_0xB4, &&op_0xB5, &&op_0xB6, &&op_0xB7,
+		&&op_0xB8, &&op_0xB9, &&op_0xBA, &&op_0xBB, &&op_0xBC, &&op_0xBD, &&op_0xBE, &&op_0xBF,
+		&&op_0xC0, &&op_0xC1, &&op_0xC2, &&op_0xC3, &&op_0xC4, &&op_0xC5, &&op_0xC6, &&op_0xC7,
+		&&op_0xC8, &&op_0xC9, &&op_0xCA, &&op_0xCB, &&op_0xCC, &&op_0xCD, &&op_0xCE, &&op_0xCF,
+		&&op_0xD0, &&op_0xD1, &&op_0xD2, &&op_invalid, &&op_0xD4, &&op_0xD5, &&op_0xD6, &&op_0xD7,
+		&&op_0xD8, &&op_0xD9, &&op_0xDA, &&op_invalid, &&op_0xDC, &&op_invalid, &&op_0xDE, &&op_0xDF,
+		&&op_0xE0, &&op_0xE1, &&op_0xE2, &&op_invalid, &&op_invalid, &&op_0xE5, &&op_0xE6, &&op_0xE7,
+		&&op_0xE8, &&op_0xE9, &&op_0xEA, &&op_invalid, &&op_invalid, &&op_invalid, &&op_0xEE, &&op_0xEF,
+		&&op_0xF0, &&op_0xF1, &&op_0xF2, &&op_0xF3, &&op_invalid, &&op_0xF5, &&op_0xF6, &&op_0xF7,
+		&&op_0xF8, &&op_0xF9, &&op_0xFA, &&op_0xFB, &&op_invalid, &&op_invalid, &&op_0xFE, &&op_0xFF,
+	};
+	static const void *cb_labels[0x100] = {
+		&&cb_0x00, &&cb_0x01, &&cb_0x02, &&cb_0x03, &&cb_0x04, &&cb_0x05, &&cb_0x06, &&cb_0x07,
+		&&cb_0x08, &&cb_0x09, &&cb_0x0A, &&cb_0x0B, &&cb_0x0C, &&cb_0x0D, &&cb_0x0E, &&cb_0x0F,
+		&&cb_0x10, &&cb_0x11, &&cb_0x12, &&cb_0x13, &&cb_0x14, &&cb_0x15, &&cb_0x16, &&cb_0x17,
+		&&cb_0x18, &&cb_0x19, &&cb_0x1A, &&cb_0x1B, &&cb_0x1C, &&cb_0x1D, &&cb_0x1E, &&cb_0x1F,
+		&&cb_0x20, &&cb_0x21, &&cb_0x22, &&cb_0x23, &&cb_0x24, &&cb_0x25, &&cb_0x26, &&cb_0x27,
+		&&cb_0x28, &&cb_0x29, &&cb_0x2A, &&cb_0x2B, &&cb_0x2C, &&cb_0x2D, &&cb_0x2E, &&cb_0x2F,
+		&&cb_0x30, &&cb_0x31, &&cb_0x32, &&cb_0x33, &&cb_0x34, &&cb_0x35, &&cb_0x36, &&cb_0x37,
+		&&cb_0x38, &&cb_0x39, &&cb_0x3A, &&cb_0x3B, &&cb_0x3C, &&cb_0x3D, &&cb_0x3E, &&cb_0x3F,
+		&&cb_0x40, &&cb_0x41, &&cb_0x42, &&cb_0x43, &&cb_0x44, &&cb_0x45, &&cb_0x46, &&cb_0x47,
+		&&cb_0x48, &&cb_0x49, &&cb_0x4A, &&cb_0x4B, &&cb_0x4C, &&cb_0x4D, &&cb_0x4E, &&cb_0x4F,
+		&&cb_0x50, &&cb_0x51, &&cb_0x52, &&cb_0x53, &&cb_0x54, &&cb_0x55, &&cb_0x56, &&cb_0x57,
+		&&cb_0x58, &&cb_0x59, &&cb_0x5A, &&cb_0x5B, &&cb_0x5C, &&cb_0x5D, &&cb_0x5E, &&cb_0x5F,
+		&&cb_0x60, &&cb_0x61, &&cb_0x62, &&cb_0x63, &&cb_0x64, &&cb_0x65, &&cb_0x66, &&cb_0x67,
+		&&cb_0x68, &&cb_0x69, &&cb_0x6A, &&cb_0x6B, &&cb_0x6C, &&cb_0x6D, &&cb_0x6E, &&cb_0x6F,
+		&&cb_0x70, &&cb_0x71, &&cb_0x72, &&cb_0x73, &&cb_0x74, &&cb_0x75, &&cb_0x76, &&cb_0x77,
+		&&cb_0x78, &&cb_0x79, &&cb_0x7A, &&cb_0x7B, &&cb_0x7C, &&cb_0x7D, &&cb_0x7E, &&cb_0x7F,
+		&&cb_0x80, &&cb_0x81, &&cb_0x82, &&cb_0x83, &&cb_0x84, &&cb_0x85, &&cb_0x86, &&cb_0x87,
+		&&cb_0x88, &&cb_0x89, &&cb_0x8A, &&cb_0x8B, &&cb_0x8C, &&cb_0x8D, &&cb_0x8E, &&cb_0x8F,
+		&&cb_0x90, &&cb_0x91, &&cb_0x92, &&cb_0x93, &&cb_0x94, &&cb_0x95, &&cb_0x96, &&cb_0x97,
+		&&cb_0x98, &&cb_0x99, &&cb_0x9A, &&cb_0x9B, &&cb_0x9C, &&cb_0x9D, &&cb_0x9E, &&cb_0x9F,
+		&&cb_0xA0, &&cb_0xA1, &&cb_0xA2, &&cb_0xA3, &&cb_0xA4, &&cb_0xA5, &&cb_0xA6, &&cb_0xA7,
+		&&cb_0xA8, &&cb_0xA9, &&cb_0xAA, &&cb_0xAB, &&cb_0xAC, &&cb_0xAD, &&cb_0xAE, &&cb_0xAF,
+		&&cb_0xB0, &&cb_0xB1, &&cb_0xB2, &&cb_0xB3, &&cb_0xB4, &&cb_0xB5, &&cb_0xB6, &&cb_0xB7,
+		&&cb_0xB8, &&cb_0xB9, &&cb_0xBA, &&cb_0xBB, &&cb_0xBC, &&cb_0xBD, &&cb_0xBE, &&cb_0xBF,
+		&&cb_0xC0, &&cb_0xC1, &&cb_0xC2, &&cb_0xC3, &&cb_0xC4, &&cb_0xC5, &&cb_0xC6, &&cb_0xC7,
+		&&cb_0xC8, &&cb_0xC9, &&cb_0xCA, &&cb_0xCB, &&cb_0xCC, &&cb_0xCD, &&cb_0xCE, &&cb_0xCF,
+		&&cb_0xD0, &&cb_0xD1, &&cb_0xD2, &&cb_0xD3, &&cb_0xD4, &&cb_0xD5, &&cb_0xD6, &&cb_0xD7,
+		&&cb_0xD8, &&cb_0xD9, &&cb_0xDA, &&cb_0xDB, &&cb_0xDC, &&cb_0xDD, &&cb_0xDE, &&cb_0xDF,
+		&&cb_0xE0, &&cb_0xE1, &&cb_0xE2, &&cb_0xE3, &&cb_0xE4, &&cb_0xE5, &&cb_0xE6, &&cb_0xE7,
+		&&cb_0xE8, &&cb_0xE9, &&cb_0xEA, &&cb_0xEB, &&cb_0xEC, &&cb_0xED, &&cb_0xEE, &&cb_0xEF,
+		&&cb_0xF0, &&cb_0xF1, &&cb_0xF2, &&cb_0xF3, &&cb_0xF4, &&cb_0xF5, &&cb_0xF6, &&cb_0xF7,
+		&&cb_0xF8, &&cb_0xF9, &&cb_0xFA, &&cb_0xFB, &&cb_0xFC, &&cb_0xFD, &&cb_0xFE, &&cb_0xFF,
+	};
+	struct gb_state held, *regs = &held;
+	uint16_t start, pc, nn;
+	uint8_t op[3], cb_op = 0;
+	uint8_t tmp;
+	int cycles, cb;
+
+#define FETCH() \
+	do { \
+		if (state->halt) \
+			goto halted; \
+		start = pc = regs->pc; \
+		fetch(pc, op); \
+		nn = ((uint16_t)op[2] << 8) | op[1]; \
+		regs->pc++; \
+		cycles = 4; \
+		cb = 0; \
+	} while (0)
+/*
+ * Only counts the cycles when no event, interrupt or loop is due and
+ * leaves the rest to the shared code at finish and clock below.
+ */
+#define NEXT \
+	do { \
+		if (debug_enabled) \
+			goto finish; \
+		finish_instruction(state, pc, op, cycles); \
+		if (cycle_count + cycles >= next_event || irq_pending \
+			|| (uint16_t)(start - regs->pc) < MAX_BLOCK_BYTES) \
+			goto clock; \
+		cycle_count += cycles; \
+		FETCH(); \
+		goto *op_labels[op[0]]; \
+	} while (0)
+#define CB_PREFIX \
+	do { \
+		cb_op = op[1]; \
+		regs->pc++; \
+		cycles = 8; \
+		cb = 1; \
+		goto *cb_labels[cb_op]; \
+	} while (0)
+
+	copy_regs(regs, state);
+	FETCH();
+	goto *op_labels[op[0]];
+
+finish:
+	copy_regs(state, regs);
+	if (cb)
+		handle_debug(pc + 1, state->pc, &cb_op, cycles, 1);
+	finish_instruction(state, pc, op, cycles);
+	goto clocked;
+clock:
+	copy_regs(state, regs);
+clocked:
+	clock_cycles(state, cycles);
+	if (!state->halt && (uint16_t)(start - state->pc) < MAX_BLOCK_BYTES)
+		loop_branch(state, start);
+	if (cpu_stop)
+		return;
+	copy_regs(regs, state);
+	FETCH();
+	goto *op_labels[op[0]];
+
+halted:
+	copy_regs(state, regs);
+	while (state->halt) {
+		clock_halted(state);
+		if (cpu_stop)
+			return;
+	}
+	copy_regs(regs, state);
+	FETCH();
+	goto *op_labels[op[0]];
+
+#define OP(n) op_##n:
+#include "opcodes.h"
+#undef OP
+#define OP(n) cb_##n:
+#include "opcodes_cb.h"
+#undef OP
+#undef FETCH
+#undef NEXT
+#undef CB_PREFIX
+op_invalid:
+	fprintf(stderr, "%04X : %02X does not exist\n", pc, op[0]);
+	exit(0);
+}
+
+#ifdef JIT
+/*
+ * Runs the compiled code of block b if no interrupt can be taken
+ * before its last instruction, then finishes and clocks each
+ * instruction it ran in order as the interpreter would have.
+ * Returns the index of the first uop left for the interpreter or -1
+ * when the block is done.
+ */
+int run_native(struct gb_state *state, struct block *b) {
+	struct native_block *nb = b->native;
+	uint16_t pc = b->pc;
+	int i, n, taken, cycles;
+
+	if (!nb) {
+		if (b->pc < 0x8000 && ++b->hits == JIT_THRESHOLD)
+			b->native = jit_compile(state, b);
+		return 0;
 	}
-	for (i = 0; i < cycles; i++) {
-		gpu_tick();
+	if (state->ei_flag || state->di_flag || nb->budget > cycles_to_interrupt(state))
+		return 0;
+	sync_flags(state);
+	n = nb->fn();
+	taken = n & JIT_TAKEN;
+	n &= ~JIT_TAKEN;
+	for (i = 0; i < n; i++) {
+		struct uop *u = &b->uops[i];
+		cycles = nb->cycles[i];
+		if (i == nb->count - 1 && taken)
+			cycles = nb->taken;
+		finish_instruction(state, pc, u->op, cycles);
+		clock_cycles(state, cycles);
+		pc += u->len;
 	}
-	handle_timers(state, cycles);
-	total_cycles += cycles;
-	if (total_cycles >= CYCLES_PER_FRAME) {
-		on_frame_end();
-		if (++save_timer == SAVE_INTERVAL) {
-			save_ram();
-			save_timer = 0;
+	if (n == b->count || state->pc != pc)
+		return -1;
+	return n;
+}
+#endif
+
+/*
+ * Block cache core. Runs straight-line blocks that were decoded once
+ * per (ROM bank, PC) so the opcode and operands come from the block
+ * instead of get_mem. A block is left early when the flow of control
+ * changes (taken branch, interrupt) or when block_exit reports that
+ * the block may be stale. Code outside ROM, WRAM and HRAM runs
+ * through tick(). The jit core runs hot ROM blocks as native code.
+ */
+void run_cached(struct gb_state *state) {
+	struct gb_state *regs = state;
+	struct block *b;
+	struct uop *u;
+	uint16_t pc, nn;
+	uint8_t op[3], len;
+	uint8_t tmp;
+	int i, cycles, cb;
+
+	while (!cpu_stop) {
+		if (state->halt) {
+			clock_halted(state);
+			continue;
+		}
+		b = get_block(state->pc);
+		if (!b) {
+			tick(state);
+			continue;
+		}
+		i = 0;
+#ifdef JIT
+		if (cpu_core == JIT_CORE) {
+			i = run_native(state, b);
+			if (i < 0)
+				continue;
+		}
+#endif
+		block_exit = 0;
+		for (; i < b->count; i++) {
+			// copied since a write by this instruction may free the block
+			u = &b->uops[i];
+			op[0] = u->op[0];
+			op[1] = u->op[1];
+			op[2] = u->op[2];
+			len = u->len;
+			nn = ((uint16_t)op[2] << 8) | op[1];
+			pc = state->pc;
+			state->pc++;
+			cycles = 4;
+			cb = 0;
+			switch (op[0]) {
+#define OP(n) case n:
+#define NEXT break
+#define CB_PREFIX cb = 1
+#include "opcodes.h"
+#undef OP
+#undef NEXT
+#undef CB_PREFIX
+			}
+			if (cb) {
+				state->pc++;
+				cycles = 8;
+				switch (op[1]) {
+#define OP(n) case n:
+#define NEXT break
+#include "opcodes_cb.h"
+#undef OP
+#undef NEXT
+				}
+				handle_debug(pc + 1, state->pc, &op[1], cycles, 1);
+			}
+			finish_instruction(state, pc, op, cycles);
+			clock_cycles(state, cycles);
+			if (block_exit || state->halt || state->pc != (uint16_t)(pc + len))
+				break;
+		}
+		if (!block_exit && state->pc == b->pc) {
+			if (b->idle)
+				check_idle(state, b);
+			else if (b->copy)
+				run_copy(state, b);
 		}
-		total_cycles = 0;
 	}
-	handle_interrupts(state);
-	return 0;
 }
 
 int run_bootstrap(struct gb_state *state) {
-	div_cycles = 0;
-	timer_cycles = 0;
+	reset_timers(state);
+	flush_blocks();
 	while (state->mem[0xFF50] != 0x01)
 	{
 		if (tick(state)) {
@@ -2855,24 +1488,84 @@ int power_up(struct gb_state *state, int bootstrap_flag) {
 	return 0;
 }
 
+/*
+ * Runs the selected core for budget cycles, up to the end of the
+ * instruction that reaches them. This is the entry point for running
+ * the CPU once power_up() and reset_timers() have run. The threaded
+ * core keeps the registers in locals while it runs, the others
+ * work on state directly. Returns the cycles that were run.
+ */
+uint64_t run_cycles(struct gb_state *state, uint32_t budget) {
+	uint64_t from = cycle_count;
+	cpu_stop = 0;
+	schedule(EV_BUDGET, cycle_count + budget);
+	if (cpu_core == THREADED_CORE)
+		run_threaded(state);
+	else if (cpu_core == CACHED_CORE || cpu_core == JIT_CORE)
+		run_cached(state);
+	else
+		while (!cpu_stop)
+			tick(state);
+	return cycle_count - from;
+}
+
 void instruction_cycle(struct gb_state *state) {
-	div_cycles = 0;
-	timer_cycles = 0;
+	reset_timers(state);
+	// drops blocks decoded from the bootstrap ROM
+	flush_blocks();
+#ifdef AOT
+	aot_active = aot_ready;
+#endif
 	while (1)
-	{
-		if (tick(state)) {
-			return;
-		}
-	}
+		run_cycles(state, CYCLES_PER_FRAME);
+}
+
+/*
+ * Selects the interpreter core by name: "switch", "threaded",
+ * "cached" or, when built with JIT, "jit".
+ * Returns nonzero if the name is unknown.
+ */
+int select_core(char *name) {
+	if (!strcmp(name, "switch"))
+		cpu_core = SWITCH_CORE;
+	else if (!strcmp(name, "threaded"))
+		cpu_core = THREADED_CORE;
+	else if (!strcmp(name, "cached"))
+		cpu_core = CACHED_CORE;
+#ifdef JIT
+	else if (!strcmp(name, "jit"))
+		cpu_core = JIT_CORE;
+#endif
+	else
+		return 1;
+	return 0;
 }
 
 void start(uint8_t *bs_mem, uint8_t *cart_mem, int bootstrap_flag) {
 	struct gb_state *state = calloc(1, sizeof(struct gb_state));
+	uint16_t port;
 	state->mem = calloc(0x10000, sizeof(uint8_t));
 	gb_mem = state->mem;
+	map_pages();
 	gbs = state;
+	add_component(COMP_GPU, gpu_sync, gpu_event, &gpu_next);
+	own_port(COMP_GPU, STAT);
+	own_port(COMP_GPU, LY);
+	own_port(COMP_GPU, IF);
+	add_component(COMP_TIMER, sync_timers, tima_event, NULL);
+	own_port(COMP_TIMER, DIV);
+	own_port(COMP_TIMER, TIMA);
+	add_component(COMP_APU, apu_sync, NULL, &apu_next);
+	for (port = NR10; port < LCDC; port++)
+		own_port(COMP_APU, port);
+	start_driver();
+#ifdef ALU_TABLES
+	init_alu_tables();
+#endif
+	init_simd();
 
 	memcpy(state->mem, cart_mem, 0x8000);
+	schedule(EV_FRAME, CYCLES_PER_FRAME);
 	uint8_t *cart_first256 = calloc(0x100, sizeof(uint8_t));
 	memcpy(cart_first256, cart_mem, 0x100);
 	if (bootstrap_flag) {
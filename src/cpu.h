@@ -1,6 +1,137 @@
 #ifndef CPU_H
 #define CPU_H
 
+#include <stdint.h>
+
+/* Bits of the F register */
+#define FLAG_Z 0x80
+#define FLAG_N 0x40
+#define FLAG_H 0x20
+#define FLAG_C 0x10
+
+#ifdef LAZY_FLAGS
+/*
+ * With LAZY_FLAGS the flags of the last ALU operation are only
+ * recorded here and the F register is brought up to date when
+ * something reads it. op is FLAGS_NONE when F is current.
+ */
+struct lazy_flags {
+	uint8_t op;
+	uint8_t a;
+	uint8_t b;
+	uint8_t res;
+	uint8_t c;
+};
+#endif
+
+/*
+ * Registers:
+ * A F (Z, N, H, C flag bits)
+ * B C
+ * D E
+ * H L
+ * SP
+ * PC
+ */
+struct gb_state
+{
+	union {
+		uint16_t af;
+		struct {
+			union {
+				uint8_t f;
+				struct {
+					uint8_t fl : 4; // 4 least sig bits not used
+					uint8_t fc : 1; // (C) Carry
+					uint8_t fh : 1; // (H) Half Carry
+					uint8_t fn : 1; // (N) Subtract
+					uint8_t fz : 1; // (Z) Zero
+				};
+			};
+			uint8_t a;
+		};
+	};
+	union {
+		uint16_t bc;
+		struct {
+			uint8_t c;
+			uint8_t b;
+		};
+	};
+	union {
+		uint16_t de;
+		struct {
+			uint8_t e;
+			uint8_t d;
+		};
+	};
+	union {
+		uint16_t hl;
+		struct {
+			uint8_t l;
+			uint8_t h;
+		};
+	};
+	uint16_t sp;
+	uint16_t pc;
+	uint16_t ime;
+	uint8_t halt;
+	uint8_t di_flag;
+	uint8_t ei_flag;
+	uint8_t *mem;
+#ifdef LAZY_FLAGS
+	struct lazy_flags lf;
+#endif
+};
+
+/* Helpers the handlers in opcodes.h and opcodes_cb.h call */
+void sync_flags(struct gb_state *state);
+uint8_t flag_z(struct gb_state *state);
+uint8_t flag_c(struct gb_state *state);
+void set_add16_flags(struct gb_state *state, uint16_t a, uint16_t b);
+void set_add8_flags(struct gb_state *state, uint8_t a, uint8_t b, int use_carry);
+void set_sub8_flags(struct gb_state *state, uint8_t a, uint8_t b, int use_carry);
+int load8val2reg(struct gb_state *state, uint8_t *reg, uint8_t val);
+void addA(struct gb_state *state, uint8_t val);
+void adc(struct gb_state *state, uint8_t val);
+void subc(struct gb_state *state, uint8_t val);
+void subA(struct gb_state *state, uint8_t val);
+void andA(struct gb_state *state, uint8_t val);
+void xorA(struct gb_state *state, uint8_t val);
+void orA(struct gb_state *state, uint8_t val);
+void cpA(struct gb_state *state, uint8_t val);
+void pop(struct gb_state *state, uint16_t *dest);
+void ret(struct gb_state *state, uint8_t condition);
+void jump(struct gb_state *state, uint8_t condition, uint16_t dest);
+void write_mem(struct gb_state *state, struct gb_state *regs, uint16_t addr, uint8_t val);
+void push(struct gb_state *state, struct gb_state *regs, uint16_t val);
+void call(struct gb_state *state, struct gb_state *regs, uint8_t condition, uint16_t addr);
+void rst(struct gb_state *state, struct gb_state *regs, uint16_t val);
+void rot_right(struct gb_state *state, uint8_t *reg);
+void rot_right_carry(struct gb_state *state, uint8_t *reg);
+void rot_left_carry(struct gb_state *state, uint8_t *reg);
+void rot_left(struct gb_state *state, uint8_t *reg);
+void sla(struct gb_state *state, uint8_t *reg);
+void sra(struct gb_state *state, uint8_t *reg);
+void srl(struct gb_state *state, uint8_t *reg);
+void swap(struct gb_state *state, uint8_t *reg);
+void bit(struct gb_state *state, uint8_t bit, uint8_t *reg);
+void res(struct gb_state *state, uint8_t bit, uint8_t *reg);
+void set(struct gb_state *state, uint8_t bit, uint8_t *reg);
+void daa(struct gb_state *state);
+
+void handle_debug(int start_pc, int pc, uint8_t* op, int cycles, int cb);
+void finish_instruction(struct gb_state *state, uint16_t pc, uint8_t *op, int cycles);
+void clock_cycles(struct gb_state *state, int cycles);
+extern uint8_t irq_pending;
+void update_interrupts();
+void request_interrupt(uint8_t bits);
+void sync_timers();
+void timers_written();
+
+uint64_t run_cycles(struct gb_state *state, uint32_t budget);
 void start(uint8_t *bs_mem, uint8_t *cart_mem, int bootstrap_flag);
+int select_core(char *name);
+int bench_alu();
 
 #endif
@@ -97,7 +97,7 @@ void print_mem() {
 		addr = i << 4;
 		printf("%04X  ", addr);
 		for (j = 0; j < 0x10; ++j) {
-			printf("%02X ", gb_mem[addr+j]);
+			printf("%02X ", *get_mem_ptr(addr + j));
 		}
 		puts("");
 	}
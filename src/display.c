@@ -17,36 +17,19 @@ SDL_Renderer *renderer = NULL;
 uint32_t colors[4];
 uint32_t* pixels;
 
-/*
- * sprite priority is 2 bytes XXOO
- * where XX is the x position and OO is OAM ordering
- */
-uint16_t priority[SCREEN_WIDTH * SCREEN_HEIGHT];
-
-/*
- * If coordinate has a background pixel (even if written over).
- * For hiding priority 1 sprites.
- */
-uint8_t bgf[SCREEN_WIDTH * SCREEN_HEIGHT];
-
-void clear_texture() {
-	int i;
-	for (i = 0; i < SCREEN_WIDTH * SCREEN_HEIGHT; ++i)
-		pixels[i] = colors[0];
-}
-
 void clear_renderer() {
 	SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
 	SDL_RenderClear(renderer);
 }
 
+/*
+ * The GPU draws all of the lines into the texture before it is
+ * unlocked again, so it is not cleared first.
+ */
 void lock_texture() {
 	int pitch;
 	clear_renderer();
-	memset(&priority[0], 0, sizeof(uint16_t) * SCREEN_WIDTH * SCREEN_HEIGHT);
-	memset(&bgf[0], 0, SCREEN_WIDTH * SCREEN_HEIGHT);
 	SDL_LockTexture(texture, NULL, (void**)&pixels, &pitch);
-	clear_texture();
 }
 
 int start_display(int scale_factor) {
@@ -81,42 +64,20 @@ int start_display(int scale_factor) {
 }
 
 /*
- * If pixel from texture pixel mapping is color[0] or not set
+ * Draws a finished line from the GPU line buffer at y.
  */
-int empty_pixel(int idx) {
-	uint32_t p = pixels[idx];
-	return p != colors[1] && p != colors[2] && p != colors[3];
+void draw_line(int y, uint8_t *line) {
+	uint32_t *row = &pixels[SCREEN_WIDTH * y];
+	for (int x = 0; x < SCREEN_WIDTH; x++)
+		row[x] = colors[line[x] & LINE_SHADE];
 }
 
 /*
- * Draws a pixel
- *
- * bg pixels are always written because they are drawn first
- *
- * A non-bg pixel is written if there is no 1,2, or 3 pixel drawn
- * yet or if the pixel has priority over any other sprites and
- * it isn't hidden behind a background.
- *
- * rc is set if the given color is color 0 on the palette. This is
- * important because priority 1 sprites need to write over bg color 0
- * but bg color 0 is different based on the palette.
+ * Points drawing at fb instead of the texture, so frames can be drawn
+ * without a window.
  */
-void draw_pixel(int x, int y, uint8_t color, int bg, uint8_t rc, int prty, uint16_t sprty) {
-	if (x < 0 || x >= SCREEN_WIDTH || y < 0 || y >= SCREEN_HEIGHT)
-		return;
-
-	int idx = SCREEN_WIDTH * y + x;
-
-	if (bg) {
-		pixels[idx] = colors[color];
-		
-		bgf[idx] = rc;
-		priority[idx] = NO_PRIORITY;
-	}
-	else if (empty_pixel(idx) ||  ((sprty < priority[idx]) && !(prty && bgf[idx]))) {
-		priority[idx] = sprty;
-		pixels[idx] = colors[color];
-	}
+void set_framebuffer(uint32_t *fb) {
+	pixels = fb;
 }
 
 void ready_render() {
@@ -6,16 +6,18 @@
 #include <stdlib.h>
 #include <unistd.h>
 
-// value that sprite priority can't be OAM size is less than 0xFF
-#define NO_PRIORITY 0xFFFF
+// bits of a pixel in the GPU line buffer
+#define LINE_SHADE 0x03
+#define LINE_BG 0x04
+#define LINE_OBJ 0x08
 
 int start_display(int scale_factor);
 void end_display();
 void clear_renderer();
 
-// prty: sprite priority flag, sprty: sprite priority (see display.c)
-void draw_pixel(int x, int y, uint8_t c, int bg, uint8_t rc, int prty, uint16_t sprty);
+void draw_line(int y, uint8_t *line);
 
+void set_framebuffer(uint32_t *fb);
 void display_render();
 void finish_row();
 void ready_render();
@@ -6,6 +6,9 @@
 #include "debug.h"
 #include "cpu.h"
 #include "mem.h"
+#include "perf.h"
+#include "aot.h"
+#include "sched.h"
 
 uint8_t *read_file(char *path, long *size) {
 	FILE *fp = fopen(path, "rb");
@@ -24,10 +27,15 @@ uint8_t *read_file(char *path, long *size) {
 }
 
 void at_exit_debug() {
+	sync_all();
 	fprintf_debug_info(stdout);
 	print_mem();
 }
 
+void at_exit_perf() {
+	fprintf_perf_info(stdout);
+}
+
 int main(int argc, char **argv) {
 	char *bootstrap_path = NULL;
 	char *cart_path = NULL;
@@ -35,6 +43,8 @@ int main(int argc, char **argv) {
 	int scale_factor = 2;
 	int debug_flag = 0;
 	int debug_size = 0;
+	int perf_flag = 0;
+	char *aot_path = NULL;
 	if (argc > 1) {
 		for (int i = 1; i < argc; i++) {
 			if (!strcmp(argv[i],"-c") && i < argc - 1) {
@@ -63,6 +73,22 @@ int main(int argc, char **argv) {
 					return 1;
 				}
 				scale_factor = atoi(argv[++i]);
+			} else if (!strcmp(argv[i],"-e") && i < argc - 1) {
+				if (select_core(argv[++i])) {
+					fprintf(stderr, "Unknown core: %s\n", argv[i]);
+					return 1;
+				}
+			} else if (!strcmp(argv[i],"-S") && i < argc - 1) {
+				if (select_driver(argv[++i])) {
+					fprintf(stderr, "Unknown driver: %s\n", argv[i]);
+					return 1;
+				}
+			} else if (!strcmp(argv[i],"-a") && i < argc - 1) {
+				aot_path = argv[++i];
+			} else if (!strcmp(argv[i],"-p")) {
+				perf_flag = 1;
+			} else if (!strcmp(argv[i],"-B")) {
+				return run_benchmarks() ? 1 : 0;
 			} else {
 				fprintf(stderr, "Illegal argument: %s\n", argv[i]);
 				return 1;
@@ -84,6 +110,11 @@ int main(int argc, char **argv) {
 		debug_enabled = 0;
 	}
 
+	if (perf_flag) {
+		init_perf();
+		atexit(at_exit_perf);
+	}
+
 	long bs_size = 0;
 	long cart_size = 0;
 	uint8_t *bs_mem = 0;
@@ -95,8 +126,21 @@ int main(int argc, char **argv) {
 		}
 	}
 	uint8_t *cart_mem = read_file(cart_path, &cart_size);
+	if (!cart_mem) {
+		return 1;
+	}
+
+	if (aot_path) {
+		setup_mem_banks(cart_mem, cart_path);
+		return recompile(cart_mem, cart_size, aot_path);
+	}
+#ifdef AOT
+	if (aot_load(cart_mem, cart_size)) {
+		fprintf(stderr, "Recompiled code is not from %s, interpreting it\n", cart_path);
+	}
+#endif
 
-	if (!cart_mem || start_display(scale_factor)) {
+	if (start_display(scale_factor)) {
 		return 1;
 	}
 	setup_mem_banks(cart_mem, cart_path);
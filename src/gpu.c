@@ -1,10 +1,16 @@
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
 #include <time.h>
 
 #include "mem.h"
 #include "gpu.h"
 #include "display.h"
+#include "sched.h"
+#include "cpu.h"
+#include "perf.h"
+#include "simd.h"
 
 
 #define SPRITE_X_OFFSET 8
@@ -14,13 +20,16 @@
 #define OAM_READ_TIME 83
 #define OAM_VRAM_READ_TIME 169
 #define HBLANK_TIME 207
+#define LINE_TIME (OAM_READ_TIME + OAM_VRAM_READ_TIME + HBLANK_TIME)
 #define SCANLINE_TIME 456
 #define REFRESH_TIME 70224
 #define VBLANK_LINE 144
 #define FINAL_LINE 153
 
 #define OAM_COUNT 40
+#define LINE_SPRITE_MAX 10
 #define BG_TILE_MAX 32
+#define TILE_COUNT 384
 
 enum dstate {HBLANK, VBLANK, OAM_READ, OAM_VRAM_READ};
 enum dstate dstate = OAM_READ;
@@ -39,49 +48,146 @@ struct gt {
 struct gt gtt;
 
 /*
- * Draws row based on row0, row1 at x and y with color from pal.
- * Does not draw sprite color 0. Flips sprites if xflip is set.
- * pstart is used to start at a pixel other than 0. prty is the sprite
- * priority flag (0 or 1). sprty is used to decide priority between
- * two sprites (leftmost has priority else OAM ordering is used)
+ * The scanline being drawn. Each pixel holds its shade in LINE_SHADE,
+ * LINE_BG if the background or window color there is not color 0,
+ * which hides priority 1 sprites, and LINE_OBJ once a sprite has
+ * taken the pixel.
  */
-void draw_tile_row(int x, int y, uint8_t row0, uint8_t row1, uint8_t pal, int sprite, int xflip, int pstart, int prty, uint16_t sprty) {
-	uint8_t color, c;
-	int i;
-	if (pstart) {
-		if (xflip) {
-			row0 = row0 >> pstart;
-			row1 = row1 >> pstart;
-		} else {
-			row0 = row0 << pstart;
-			row1 = row1 << pstart;
-		}
+uint8_t line_buf[SCREEN_WIDTH];
+
+/*
+ * Tiles at 0x8000-0x97FF decoded to one color index per pixel, with
+ * each row both as stored and flipped. A tile is decoded when it is
+ * first drawn after set_mem wrote to it (see tile_written).
+ */
+uint8_t tile_pix[TILE_COUNT][2][8][8];
+uint8_t tile_valid[TILE_COUNT];
+
+void decode_tile(int tile) {
+	decode_tile_rows(&gb_mem[VIDEO_RAM + tile * 16], tile_pix[tile][0][0], tile_pix[tile][1][0]);
+	tile_valid[tile] = 1;
+}
+
+/*
+ * Returns the color indices of row line of tile (counted from 0x8000),
+ * flipped if xflip is set.
+ */
+uint8_t *tile_row(int tile, int line, int xflip) {
+	if (!tile_valid[tile])
+		decode_tile(tile);
+	return tile_pix[tile][xflip][line];
+}
+
+/*
+ * Called by set_mem after a write to the tile data at addr.
+ */
+void tile_written(uint16_t addr) {
+	tile_valid[(addr - VIDEO_RAM) >> 4] = 0;
+}
+
+/*
+ * Drops every decoded tile, for when tile data was written without
+ * set_mem.
+ */
+void flush_tiles() {
+	memset(tile_valid, 0, sizeof(tile_valid));
+}
+
+/*
+ * Returns the tile the background or window tile map entry index
+ * points at. With bg_tile_sel clear index is signed and relative to
+ * 0x9000.
+ */
+int bg_tile(uint8_t index, int bg_tile_sel) {
+	return bg_tile_sel ? index : 0x100 + (int8_t)index;
+}
+
+/*
+ * Fills pix with the line buffer pixel of each background color
+ * under pal.
+ */
+void bg_palette(uint8_t pal, uint8_t *pix) {
+	for (int color = 0; color < 4; color++)
+		pix[color] = ((pal >> (2 * color)) & 0x3) | (color ? LINE_BG : 0);
+}
+
+/*
+ * Draws background or window row of color indices into the line
+ * buffer with its leftmost pixel at x, mapping each color through
+ * pix (see bg_palette). Rows partly off the screen are drawn aside
+ * and only their visible pixels copied.
+ */
+void draw_tile_row(int x, uint8_t *row, uint8_t *pix) {
+	uint8_t tmp[8];
+	if (x >= 0 && x <= SCREEN_WIDTH - 8) {
+		map_row(&line_buf[x], row, pix);
+		return;
 	}
-	for (i = 0; i < 8 - pstart; i++) {
-		if (xflip) {
-			// colors are 2 bits so 2 rows are combined to get the color
-			color = ((row1 << 1) & 0x02) | (row0 & 0x1);
-			c = (pal >> (2 * color)) & 0x3;
-			row0 = row0 >> 1;
-			row1 = row1 >> 1;
-		} else {
-			color = (((row1 >> 7) << 1) | (row0 >> 7)) & 0x3;
-			c = (pal >> (2 * color)) & 0x3;
-			row0 = row0 << 1;
-			row1 = row1 << 1;
-		}
-		// sprite color 0 is transparent so do not draw
-		if (!sprite || color != 0)
-			draw_pixel(x + i, y, c, !sprite, c != (pal & 0x3) , prty, sprty);
+	int i = x < 0 ? -x : 0;
+	int end = x > SCREEN_WIDTH - 8 ? SCREEN_WIDTH - x : 8;
+	if (i >= end)
+		return;
+	map_row(tmp, row, pix);
+	memcpy(&line_buf[x + i], &tmp[i], end - i);
+}
+
+/*
+ * Draws sprite row of color indices into the line buffer like
+ * draw_tile_row with colors from pal. Sprites are drawn highest
+ * priority first and the first one with a color other than 0 at a
+ * pixel takes it. It is only drawn there if prty (the sprite
+ * priority flag) is clear or the background is color 0.
+ */
+void draw_sprite_row(int x, uint8_t *row, uint8_t pal, int prty) {
+	uint8_t tmp[8] = {0};
+	if (x >= 0 && x <= SCREEN_WIDTH - 8) {
+		blend_row(&line_buf[x], row, pal, prty);
+		return;
 	}
+	int i = x < 0 ? -x : 0;
+	int end = x > SCREEN_WIDTH - 8 ? SCREEN_WIDTH - x : 8;
+	if (i >= end)
+		return;
+	memcpy(&tmp[i], &line_buf[x + i], end - i);
+	blend_row(tmp, row, pal, prty);
+	memcpy(&line_buf[x + i], &tmp[i], end - i);
 }
 
 /*
- * Draws the appropriate sprite lines at the given y.
- * All sprites in the OAM table are checked if they are part of the
- * current y. If they are then their pattern is retrieved from the
- * sprite pattern table at 0x8000. Palette, xflip, and yflip are
- * all retrieved from the OAM table as well.
+ * The sprites on the line being drawn, found by oam_search(). Each is
+ * its priority: the sprite's x position in the high byte and its OAM
+ * index in the low byte, so the list is sorted leftmost first and by
+ * OAM ordering between sprites at the same x.
+ */
+uint16_t line_sprites[LINE_SPRITE_MAX];
+int line_sprite_count;
+
+/*
+ * Finds the sprites on line y like the OAM search at the start of
+ * each line. Only the first LINE_SPRITE_MAX sprites in OAM ordering
+ * are drawn, even those off the screen to the side count.
+ */
+void oam_search(uint8_t y) {
+	uint8_t obj_height = get_lcdc()->obj_size ? 16 : 8;
+	int i, j;
+	line_sprite_count = 0;
+	for (i = 0; i < OAM_COUNT && line_sprite_count < LINE_SPRITE_MAX; i++) {
+		struct sprite_attr *sprite_attr = get_sprite_attr(i);
+		int y_start = sprite_attr->y - SPRITE_Y_OFFSET;
+		if (y_start > y || y_start + obj_height <= y)
+			continue;
+		uint16_t prty = ((uint16_t)sprite_attr->x << 8) | i;
+		for (j = line_sprite_count++; j > 0 && line_sprites[j - 1] > prty; j--)
+			line_sprites[j] = line_sprites[j - 1];
+		line_sprites[j] = prty;
+	}
+}
+
+/*
+ * Draws the sprites oam_search() found on y, highest priority first.
+ * Their pattern is retrieved from the sprite pattern table at 0x8000.
+ * Palette, xflip, and yflip are all retrieved from the OAM table as
+ * well.
  */
 void draw_sprites(uint8_t y) {
 	struct lcdc *lcdc = get_lcdc();
@@ -89,27 +195,26 @@ void draw_sprites(uint8_t y) {
 		return;
 
 	uint8_t obj_scale = lcdc->obj_size ? 2 : 1;
-	uint8_t obj_height = obj_scale * 8;
 
-	for (uint8_t i = 0; i < OAM_COUNT; i++) {
-		struct sprite_attr *sprite_attr = get_sprite_attr(i);
+	for (int i = 0; i < line_sprite_count; i++) {
+		struct sprite_attr *sprite_attr = get_sprite_attr(line_sprites[i] & 0xFF);
 		int y_start = sprite_attr->y - SPRITE_Y_OFFSET;
 		int x_start = sprite_attr->x - SPRITE_X_OFFSET;
+		uint8_t line = y - y_start;
+		uint8_t pattern = sprite_attr->pattern;
+		// 8x16 sprites ignore bit 0 of the pattern, as get_sprite_data()
+		// did before the tile cache
+		if (lcdc->obj_size)
+			pattern &= 0xFE;
+		if (sprite_attr->yflip)
+			line = 8 * obj_scale - 1 - line;
 
-		if (y_start <= y && y_start + obj_height > y) {
-			uint8_t line = y - y_start;
-			uint8_t *data = get_sprite_data(sprite_attr->pattern, 0);
-			if (sprite_attr->yflip)
-				line = 8 * obj_scale - 1 - line;
-
-			uint8_t row0 = data[line * 2];
-			uint8_t row1 = data[line * 2 + 1];
-			uint8_t pal = gb_mem[OBP0];
-			if (sprite_attr->palette) {
-				pal = gb_mem[OBP1];
-			}
-			draw_tile_row(x_start, y, row0, row1, pal, 1, sprite_attr->xflip, 0, sprite_attr->priority, ((uint16_t)sprite_attr->x << 8) | i);
+		uint8_t *row = tile_row(pattern + line / 8, line % 8, sprite_attr->xflip);
+		uint8_t pal = gb_mem[OBP0];
+		if (sprite_attr->palette) {
+			pal = gb_mem[OBP1];
 		}
+		draw_sprite_row(x_start, row, pal, sprite_attr->priority);
 	}
 }
 
@@ -137,6 +242,9 @@ void draw_window(uint8_t y) {
 	if (y < wy)
 		return;
 
+	uint8_t pix[4];
+	bg_palette(gb_mem[BGP], pix);
+
 	for (int i = 0; i < BG_TILE_MAX; i++) {
 		uint8_t tile = i;
 		// WX = Window X Position - 7
@@ -147,10 +255,8 @@ void draw_window(uint8_t y) {
 		uint8_t line = (y - wy) % 8;
 		uint16_t tile_addr = tm_addr + tile + y_start * BG_TILE_MAX;
 		uint8_t index = gb_mem[tile_addr];
-		uint8_t *data = get_tile_data(index, 16, lcdc->bg_tile_sel);
-		uint8_t row0 = data[line * 2];
-		uint8_t row1 = data[line * 2 + 1];
-		draw_tile_row(tile_start_x, y, row0, row1, gb_mem[BGP], 0, 0, 0, 0, NO_PRIORITY);
+		uint8_t *row = tile_row(bg_tile(index, lcdc->bg_tile_sel), line, 0);
+		draw_tile_row(tile_start_x, row, pix);
 	}
 }
 
@@ -179,26 +285,32 @@ void draw_background(uint8_t y) {
 	uint8_t x_off = scx % 8;
 	uint8_t y_start = (uint8_t)(y + scy) / 8;
 	uint8_t line = (uint8_t)(scy + y) % 8;
-	for (int i = 0; i < BG_TILE_MAX; i++) {
+	uint8_t pix[4];
+	bg_palette(gb_mem[BGP], pix);
+	// the first tile starts x_off pixels left of the screen
+	for (int i = 0; i <= SCREEN_WIDTH / 8; i++) {
 		uint8_t tile = (uint8_t)(i * 8 + scx) / 8;
-		uint8_t offset = i ? x_off : 0;
-		uint8_t tile_start_x = i * 8 - offset;
-		int pstart = !i ? x_off : 0;
 		uint16_t tile_addr = tm_addr + tile + y_start * BG_TILE_MAX;
 		uint8_t index = gb_mem[tile_addr];
-		uint8_t *data = get_tile_data(index, 16, lcdc->bg_tile_sel);
-		uint8_t row0 = data[line * 2];
-		uint8_t row1 = data[line * 2 + 1];
-		draw_tile_row(tile_start_x, y, row0, row1, gb_mem[BGP], 0, 0, pstart, 0, NO_PRIORITY);
+		uint8_t *row = tile_row(bg_tile(index, lcdc->bg_tile_sel), line, 0);
+		draw_tile_row(i * 8 - x_off, row, pix);
 	}
 }
 
+/*
+ * Draws the background, window and sprites at y into the line buffer
+ * and then the finished line to the screen. Without the background
+ * the line starts out as color 0 in shade 0.
+ */
 void draw_scan_line(uint8_t y) {
 	if (y >= SCREEN_HEIGHT)
 		return;
+	memset(line_buf, 0, sizeof(line_buf));
+	oam_search(y);
 	draw_background(y);
 	draw_window(y);
 	draw_sprites(y);
+	draw_line(y, line_buf);
 }
 
 /*
@@ -250,7 +362,7 @@ int gpu_tick() {
 			}
 			if (current_line >= VBLANK_LINE) {
 				// VBLANK
-				get_if()->vblank = 1;
+				request_interrupt(0x01);
 				set_stat_mode(VBLANK);
 				dstate = VBLANK;
 				ready_render();
@@ -276,3 +388,214 @@ int gpu_tick() {
 	}
 	return 0;
 }
+
+/*
+ * Returns how many ticks can pass before the GPU next changes mode or
+ * LY, which is when it may request an interrupt. -1 if the LCD is off
+ * since nothing happens until it is turned back on.
+ */
+int gpu_cycles_to_event() {
+	int t;
+	if (!get_lcdc()->lcd_control_op)
+		return -1;
+	if (reset)
+		return 0;
+	switch (dstate) {
+		case OAM_READ:
+			t = OAM_READ_TIME - gtt.ort;
+			break;
+		case OAM_VRAM_READ:
+			t = OAM_VRAM_READ_TIME - gtt.ovrt;
+			break;
+		case HBLANK:
+			t = HBLANK_TIME - gtt.hbt % HBLANK_TIME;
+			break;
+		case VBLANK:
+		default:
+			t = SCANLINE_TIME - gtt.vbt % SCANLINE_TIME;
+			break;
+	}
+	return t > 0 ? t - 1 : 0;
+}
+
+/*
+ * Same as calling gpu_tick() ticks times when ticks is no more than
+ * gpu_cycles_to_event() since the GPU only counts up until then.
+ */
+void gpu_skip(int ticks) {
+	if (!get_lcdc()->lcd_control_op) {
+		gpu_tick();
+		return;
+	}
+	switch (dstate) {
+		case OAM_READ:
+			gtt.ort += ticks;
+			break;
+		case OAM_VRAM_READ:
+			gtt.ovrt += ticks;
+			break;
+		case HBLANK:
+			gtt.hbt += ticks;
+			break;
+		case VBLANK:
+			gtt.vbt += ticks;
+			break;
+	}
+}
+
+/*
+ * Same as calling gpu_tick() ticks times. Skips ahead to each event
+ * and only ticks through the event itself.
+ */
+void gpu_advance(int ticks) {
+	int t;
+	while (ticks > 0) {
+		t = gpu_cycles_to_event();
+		if (t < 0) {
+			// nothing changes while the LCD stays off
+			gpu_tick();
+			return;
+		}
+		if (t >= ticks) {
+			gpu_skip(ticks);
+			return;
+		}
+		gpu_skip(t);
+		gpu_tick();
+		ticks -= t + 1;
+	}
+}
+
+/*
+ * The GPU only runs when something could see it: the CPU reading LY,
+ * STAT or IF, writing memory the GPU draws from or whose access it
+ * locks, an interrupt it may raise or the frame end. gpu_time is the
+ * cycle it has been run up to and gpu_next the cycle of its next mode
+ * or LY change (NEVER while the LCD is off). It starts ticking with
+ * the LCD off on the first cycle.
+ */
+uint64_t gpu_time = 0;
+uint64_t gpu_next = 1;
+
+/*
+ * Runs the GPU through every change due by cycle to. Between changes
+ * it only counts, so running them in one go is the same as ticking
+ * every cycle.
+ */
+void gpu_run(uint64_t to) {
+	int t;
+	while (gpu_next <= to) {
+		gpu_advance(gpu_next - gpu_time);
+		gpu_time = gpu_next;
+		t = gpu_cycles_to_event();
+		gpu_next = t < 0 ? NEVER : gpu_time + t + 1;
+	}
+}
+
+/*
+ * Brings the GPU up to cycle_count. It is the sync function of
+ * COMP_GPU, run before the CPU reads or writes memory that depends on
+ * the GPU.
+ */
+void gpu_sync() {
+	if (gpu_next <= cycle_count)
+		gpu_run(cycle_count);
+}
+
+/*
+ * Returns the cycle the GPU next changes mode or LY at.
+ */
+uint64_t gpu_next_change() {
+	sync_component(COMP_GPU);
+	return gpu_next;
+}
+
+/*
+ * Schedules EV_GPU no later than the next change that may raise an
+ * interrupt IE enables, which is every change if a STAT interrupt
+ * source is enabled. V-Blank alone starts at the end of line 143 so
+ * it is at least the whole lines before that away.
+ */
+void gpu_reschedule() {
+	uint8_t ie = gb_mem[IE];
+	uint64_t at = NEVER;
+	int lines = VBLANK_LINE - 1 - current_line;
+	if (gpu_next == NEVER) {
+		at = NEVER;
+	} else if ((ie & 0x02) && (gb_mem[STAT] & 0x78)) {
+		at = gpu_next;
+	} else if (ie & 0x01) {
+		at = gpu_next;
+		if (!reset && dstate != VBLANK && lines > 0
+			&& gpu_time + lines * LINE_TIME > at)
+			at = gpu_time + lines * LINE_TIME;
+	}
+	if (at == NEVER)
+		deschedule(EV_GPU);
+	else
+		schedule(EV_GPU, at);
+}
+
+/*
+ * Runs the GPU when EV_GPU is due.
+ */
+void gpu_event() {
+	gpu_run(cycle_count);
+	gpu_reschedule();
+}
+
+/*
+ * Called when a write to LCDC turns the LCD on or off. The GPU sees
+ * the change on the first tick of the writing instruction, and the
+ * ticks before it while the LCD was off changed nothing.
+ */
+void lcd_switched(int on) {
+	gpu_sync();
+	if (on)
+		gpu_time = cycle_count;
+	gpu_next = cycle_count + 1;
+	gpu_reschedule();
+}
+
+/*
+ * Times drawing whole frames of random tiles with the window and 8x16
+ * sprites on, into a buffer instead of the texture.
+ */
+void bench_render() {
+	int frames = 2000, i, y;
+	uint32_t *frame = calloc(SCREEN_WIDTH * SCREEN_HEIGHT, sizeof(uint32_t));
+	double t;
+
+	if (!gb_mem)
+		gb_mem = calloc(0x10000, sizeof(uint8_t));
+	srand(1);
+	for (i = SPRITE_TILES; i < 0xA000; i++)
+		gb_mem[i] = rand();
+	for (i = 0; i < OAM_COUNT; i++) {
+		struct sprite_attr *sprite_attr = get_sprite_attr(i);
+		sprite_attr->y = SPRITE_Y_OFFSET + rand() % SCREEN_HEIGHT;
+		sprite_attr->x = SPRITE_X_OFFSET + rand() % SCREEN_WIDTH;
+		sprite_attr->pattern = rand();
+		sprite_attr->flags = rand() & 0xF0;
+	}
+	gb_mem[LCDC] = 0xE7;
+	gb_mem[SCY] = 5;
+	gb_mem[SCX] = 3;
+	gb_mem[BGP] = 0xE4;
+	gb_mem[OBP0] = 0xD2;
+	gb_mem[OBP1] = 0x1B;
+	gb_mem[WY] = 72;
+	gb_mem[WX] = 87;
+	init_simd();
+	flush_tiles();
+	set_framebuffer(frame);
+
+	t = perf_time();
+	for (i = 0; i < frames; i++) {
+		for (y = 0; y < SCREEN_HEIGHT; y++)
+			draw_scan_line(y);
+	}
+	printf("render: %.1f us/frame\n", (perf_time() - t) * 1e6 / frames);
+	set_framebuffer(NULL);
+	free(frame);
+}
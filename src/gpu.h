@@ -1,9 +1,22 @@
 #ifndef GPU_H
 #define GPU_H
 
+#include <stdint.h>
+
 #define SCREEN_WIDTH 160
 #define SCREEN_HEIGHT 144
 
+extern uint64_t gpu_next;
+
 int gpu_tick();
+int gpu_cycles_to_event();
+void gpu_sync();
+uint64_t gpu_next_change();
+void gpu_reschedule();
+void gpu_event();
+void lcd_switched(int on);
+void tile_written(uint16_t addr);
+void flush_tiles();
+void bench_render();
 
 #endif
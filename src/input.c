@@ -1,6 +1,8 @@
 #include "input.h"
 #include "mem.h"
 #include "display.h"
+#include "perf.h"
+#include "cpu.h"
 
 #define P10 0x1
 #define P11 0x2
@@ -26,43 +28,43 @@ void handle_events() {
 				case SDLK_RIGHT:
 					p14 = ks ? p14 | P10 : p14 & 0xFE;
 					if (!ks)
-						gb_mem[IF] |= 0x10;
+						request_interrupt(0x10);
 					break;
 				case SDLK_LEFT:
 					p14 = ks ? p14 | P11 : p14 & 0xFD;
 					if (!ks)
-						gb_mem[IF] |= 0x10;
+						request_interrupt(0x10);
 					break;
 				case SDLK_UP:
 					p14 = ks ? p14 | P12 : p14 & 0xFB;
 					if (!ks)
-						gb_mem[IF] |= 0x10;
+						request_interrupt(0x10);
 					break;
 				case SDLK_DOWN:
 					p14 = ks ? p14 | P13 : p14 & 0xF7;
 					if (!ks)
-						gb_mem[IF] |= 0x10;
+						request_interrupt(0x10);
 					break;
 				case SDLK_x:
 					p15 = ks ? p15 | P10 : p15 & 0xFE;
 					if (!ks)
-						gb_mem[IF] |= 0x10;
+						request_interrupt(0x10);
 					break;
 				case SDLK_z:
 					p15 = ks ? p15 | P11 : p15 & 0xFD;
 					if (!ks)
-						gb_mem[IF] |= 0x10;
+						request_interrupt(0x10);
 					break;
 				case SDLK_RSHIFT:
 				case SDLK_LSHIFT:
 					p15 = ks ? p15 | P12 : p15 & 0xFB;
 					if (!ks)
-						gb_mem[IF] |= 0x10;
+						request_interrupt(0x10);
 					break;
 				case SDLK_RETURN:
 					p15 = ks ? p15 | P13 : p15 & 0xF7;
 					if (!ks)
-						gb_mem[IF] |= 0x10;
+						request_interrupt(0x10);
 					break;
 				case SDLK_s:
 					if (ks)
@@ -78,7 +80,7 @@ void on_frame_end() {
 	int wait_time = base_wait;
 	rem = base_wait - wait_time;
 	handle_events();
-	if (wait_time > 0)
+	if (wait_time > 0 && !perf_enabled)
 		SDL_Delay(wait_time);
 	frame_time = SDL_GetTicks();
 	return;
@@ -0,0 +1,862 @@
+#ifdef JIT
+
+#ifndef __x86_64__
+#error "JIT needs an x86-64 host"
+#endif
+
+#include <stddef.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "jit.h"
+#include "mem.h"
+
+#define CODE_SIZE (16 << 20)
+#define MAX_BLOCK_CODE 0x4000
+#define MAX_EXITS 0x200
+
+enum {RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+	R8, R9, R10, R11, R12, R13, R14, R15};
+
+/* x86 condition codes */
+#define CC_B 0x2
+#define CC_AE 0x3
+#define CC_E 0x4
+#define CC_NE 0x5
+
+/*
+ * Guest registers live in host registers while native code runs.
+ * Each 8-bit register is kept zero extended in its own host register
+ * and SP in r8. rax, rcx, rdx and r9-r11 are scratch, r9 and r10 hold
+ * the instruction count and PC on the way out.
+ */
+#define GA R12
+#define GF R13
+#define GB R14
+#define GC R15
+#define GD RBX
+#define GE RBP
+#define GH RSI
+#define GL RDI
+#define GSP R8
+
+/* Host register of each register operand of an opcode, (HL) is -1 */
+const int reg8[8] = {GB, GC, GD, GE, GH, GL, -1, GA};
+
+/* Kinds of flag updates after an 8-bit ALU instruction */
+enum {HF_ADD, HF_SUB, HF_INC, HF_DEC, HF_AND, HF_OR};
+
+uint8_t *code_buf = NULL;
+uint8_t *code_ptr;
+
+/* GB flags (Z, H, C) for the low byte of the host RFLAGS */
+uint8_t host_flags[0x100];
+
+/* Emitter state for the block being compiled */
+uint8_t *out;
+uint16_t uop_pc[MAX_BLOCK_OPS + 1];
+struct {
+	uint8_t *at;
+	int idx;
+} exits[MAX_EXITS];
+int exit_count;
+uint8_t *stubs[MAX_BLOCK_OPS];
+struct {
+	uint8_t *at;
+} epi_fix[MAX_BLOCK_OPS * 2 + 2];
+int epi_count;
+
+void e8(uint8_t b) {
+	*out++ = b;
+}
+
+void e32(uint32_t v) {
+	memcpy(out, &v, 4);
+	out += 4;
+}
+
+void e64(uint64_t v) {
+	memcpy(out, &v, 8);
+	out += 8;
+}
+
+/*
+ * REX is always emitted so the low byte of every register (sil, dil,
+ * bpl, r8b...) can be used by the 8-bit instructions.
+ */
+void rex(int w, int r, int x, int b) {
+	e8(0x40 | w << 3 | (r >> 3) << 2 | (x >> 3) << 1 | b >> 3);
+}
+
+void modrm(int mod, int reg, int rm) {
+	e8(mod << 6 | (reg & 7) << 3 | (rm & 7));
+}
+
+/* opc r/m, reg with two registers (8 or 32-bit form by opc) */
+void op_rr(uint8_t opc, int dst, int src) {
+	rex(0, src, 0, dst);
+	e8(opc);
+	modrm(3, src, dst);
+}
+
+/* 8-bit group 1 instruction (add, or, adc, sbb, and, sub, xor, cmp) */
+void op8_ri(int ext, int dst, uint8_t imm) {
+	rex(0, 0, 0, dst);
+	e8(0x80);
+	modrm(3, ext, dst);
+	e8(imm);
+}
+
+/* 32-bit group 1 instruction */
+void op32_ri(int ext, int dst, uint32_t imm) {
+	rex(0, 0, 0, dst);
+	e8(0x81);
+	modrm(3, ext, dst);
+	e32(imm);
+}
+
+void mov_ri(int dst, uint32_t imm) {
+	rex(0, 0, 0, dst);
+	e8(0xB8 + (dst & 7));
+	e32(imm);
+}
+
+void mov_r64i(int dst, uint64_t imm) {
+	rex(1, 0, 0, dst);
+	e8(0xB8 + (dst & 7));
+	e64(imm);
+}
+
+void mov_rr(int dst, int src) {
+	op_rr(0x89, dst, src);
+}
+
+void movzx8_rr(int dst, int src) {
+	rex(0, dst, 0, src);
+	e8(0x0F);
+	e8(0xB6);
+	modrm(3, dst, src);
+}
+
+/* shl (ext 4) or shr (ext 5) by imm */
+void shift_ri(int ext, int dst, uint8_t imm) {
+	rex(0, 0, 0, dst);
+	e8(0xC1);
+	modrm(3, ext, dst);
+	e8(imm);
+}
+
+/* movzx dst, byte [base + index + disp] */
+void load8_bi(int dst, int base, int index, int32_t disp) {
+	rex(0, dst, index, base);
+	e8(0x0F);
+	e8(0xB6);
+	modrm(disp ? 2 : 0, dst, 4);
+	e8((index & 7) << 3 | (base & 7));
+	if (disp)
+		e32(disp);
+}
+
+/* mov byte [base + index + disp], src */
+void store8_bi(int src, int base, int index, int32_t disp) {
+	rex(0, src, index, base);
+	e8(0x88);
+	modrm(disp ? 2 : 0, src, 4);
+	e8((index & 7) << 3 | (base & 7));
+	if (disp)
+		e32(disp);
+}
+
+/* movzx dst, byte/word [rax + off] */
+void load_state(int dst, int off, int word) {
+	rex(0, dst, 0, RAX);
+	e8(0x0F);
+	e8(word ? 0xB7 : 0xB6);
+	modrm(2, dst, RAX);
+	e32(off);
+}
+
+/* mov byte/word [rax + off], src */
+void store_state(int src, int off, int word) {
+	if (word)
+		e8(0x66);
+	rex(0, src, 0, RAX);
+	e8(word ? 0x89 : 0x88);
+	modrm(2, src, RAX);
+	e32(off);
+}
+
+void push_r(int r) {
+	rex(0, 0, 0, r);
+	e8(0x50 + (r & 7));
+}
+
+void pop_r(int r) {
+	rex(0, 0, 0, r);
+	e8(0x58 + (r & 7));
+}
+
+/* Emits a jcc/jmp with a 32-bit offset and returns where to patch it */
+uint8_t *jcc(int cc) {
+	e8(0x0F);
+	e8(0x80 + cc);
+	e32(0);
+	return out - 4;
+}
+
+uint8_t *jmp() {
+	e8(0xE9);
+	e32(0);
+	return out - 4;
+}
+
+void patch(uint8_t *at, uint8_t *target) {
+	int32_t rel = target - (at + 4);
+	memcpy(at, &rel, 4);
+}
+
+void cmp_eax(uint32_t imm) {
+	e8(0x3D);
+	e32(imm);
+}
+
+/* Leaves the block before uop idx if cc holds */
+void exit_if(int cc, int idx) {
+	exits[exit_count].at = jcc(cc);
+	exits[exit_count++].idx = idx;
+}
+
+/* Jumps to the epilogue, PC and count already in r10 and r9 */
+void to_epilogue() {
+	epi_fix[epi_count++].at = jmp();
+}
+
+/* eax = hi << 8 | lo */
+void pair_to_eax(int hi, int lo) {
+	mov_rr(RAX, hi);
+	shift_ri(4, RAX, 8);
+	op_rr(0x09, RAX, lo);
+}
+
+/* hi, lo = eax, which must be below 0x10000 */
+void eax_to_pair(int hi, int lo) {
+	movzx8_rr(lo, RAX);
+	shift_ri(5, RAX, 8);
+	mov_rr(hi, RAX);
+}
+
+void and_eax_ffff() {
+	op32_ri(4, RAX, 0xFFFF);
+}
+
+/*
+ * ecx = memory at eax. ROM bank 0, WRAM and HRAM are read directly,
+ * switchable ROM banks through get_mem (only when call is set) and
+ * anything else leaves the block.
+ */
+void emit_read(int idx, int call) {
+	uint8_t *direct0, *direct1, *banked = NULL, *done;
+	cmp_eax(0x4000);
+	direct0 = jcc(CC_B);
+	cmp_eax(0x8000);
+	if (call)
+		banked = jcc(CC_B);
+	else
+		exit_if(CC_B, idx);
+	cmp_eax(0xC000);
+	exit_if(CC_B, idx);
+	cmp_eax(ECHO_RAM);
+	direct1 = jcc(CC_B);
+	cmp_eax(INTERNAL_RAM1);
+	exit_if(CC_B, idx);
+	cmp_eax(IE);
+	exit_if(CC_E, idx);
+	patch(direct0, out);
+	patch(direct1, out);
+	mov_r64i(RDX, (uint64_t)gb_mem);
+	load8_bi(RCX, RDX, RAX, 0);
+	if (call) {
+		done = jmp();
+		patch(banked, out);
+		// keep the stack 16 byte aligned for the call
+		push_r(GH);
+		push_r(GL);
+		push_r(GSP);
+		push_r(GSP);
+		mov_rr(RDI, RAX);
+		mov_r64i(RAX, (uint64_t)get_mem);
+		e8(0xFF);
+		e8(0xD0);
+		movzx8_rr(RCX, RAX);
+		pop_r(GSP);
+		pop_r(GSP);
+		pop_r(GL);
+		pop_r(GH);
+		patch(done, out);
+	}
+}
+
+/*
+ * Leaves the block unless eax is WRAM or HRAM that no cached block
+ * was decoded from, the only memory written directly.
+ */
+void emit_write_check(int idx) {
+	uint8_t *ok;
+	cmp_eax(INTERNAL_RAM0);
+	exit_if(CC_B, idx);
+	cmp_eax(ECHO_RAM);
+	ok = jcc(CC_B);
+	cmp_eax(INTERNAL_RAM1);
+	exit_if(CC_B, idx);
+	cmp_eax(IE);
+	exit_if(CC_E, idx);
+	patch(ok, out);
+	mov_r64i(RDX, (uint64_t)code_refs);
+	rex(0, 0, RAX, RDX);
+	e8(0x80);
+	modrm(0, 7, 4);
+	e8((RAX & 7) << 3 | (RDX & 7));
+	e8(0);
+	exit_if(CC_NE, idx);
+}
+
+/* Stores cl at eax (checked by emit_write_check) */
+void emit_store() {
+	mov_r64i(RDX, (uint64_t)gb_mem);
+	store8_bi(RCX, RDX, RAX, 0);
+}
+
+/* Sets F from the host flags of the 8-bit instruction just emitted */
+void emit_flags(int kind) {
+	e8(0x9C); // pushfq
+	pop_r(R11);
+	movzx8_rr(R11, R11);
+	mov_r64i(R10, (uint64_t)host_flags);
+	load8_bi(R11, R10, R11, 0);
+	switch (kind) {
+		case HF_ADD:
+		case HF_SUB:
+			mov_rr(GF, R11);
+			if (kind == HF_SUB)
+				op8_ri(1, GF, 0x40);
+			break;
+		case HF_INC:
+		case HF_DEC:
+			op32_ri(4, GF, 0x10);
+			op32_ri(4, R11, 0xA0);
+			op_rr(0x09, GF, R11);
+			if (kind == HF_DEC)
+				op8_ri(1, GF, 0x40);
+			break;
+		case HF_AND:
+			op32_ri(4, R11, 0x80);
+			op32_ri(1, R11, 0x20);
+			mov_rr(GF, R11);
+			break;
+		case HF_OR:
+			op32_ri(4, R11, 0x80);
+			mov_rr(GF, R11);
+			break;
+	}
+}
+
+/* bt r13d, 4: host carry = C flag, for ADC and SBC */
+void carry_in() {
+	rex(0, 0, 0, GF);
+	e8(0x0F);
+	e8(0xBA);
+	modrm(3, 4, GF);
+	e8(4);
+}
+
+/*
+ * 8-bit ALU instruction group g (ADD, ADC, SUB, SBC, AND, XOR, OR, CP)
+ * on A and src.
+ */
+void emit_alu(int g, int src) {
+	static const uint8_t opc[8] = {0x00, 0x10, 0x28, 0x18, 0x20, 0x30, 0x08, 0x38};
+	static const int kind[8] = {HF_ADD, HF_ADD, HF_SUB, HF_SUB, HF_AND, HF_OR, HF_OR, HF_SUB};
+	if (g == 1 || g == 3)
+		carry_in();
+	op_rr(opc[g], GA, src);
+	emit_flags(kind[g]);
+}
+
+/* 16-bit register pair of an opcode's bits 4-5, SP as pair 3 */
+void pair_regs(int n, int *hi, int *lo) {
+	static const int his[3] = {GB, GD, GH}, los[3] = {GC, GE, GL};
+	*hi = his[n];
+	*lo = los[n];
+}
+
+/* eax = pair n (SP for 3) */
+void pair_get(int n) {
+	int hi, lo;
+	if (n == 3) {
+		mov_rr(RAX, GSP);
+		return;
+	}
+	pair_regs(n, &hi, &lo);
+	pair_to_eax(hi, lo);
+}
+
+void pair_set(int n) {
+	int hi, lo;
+	if (n == 3) {
+		mov_rr(GSP, RAX);
+		return;
+	}
+	pair_regs(n, &hi, &lo);
+	eax_to_pair(hi, lo);
+}
+
+/* eax = SP + d */
+void sp_offset(int d) {
+	mov_rr(RAX, GSP);
+	op32_ri(d < 0 ? 5 : 0, RAX, d < 0 ? -d : d);
+	and_eax_ffff();
+}
+
+/* Pushes hi then lo like push() */
+void emit_push(int idx, int hi, int lo, int imm, uint16_t val) {
+	sp_offset(-1);
+	emit_write_check(idx);
+	sp_offset(-2);
+	emit_write_check(idx);
+	sp_offset(-1);
+	if (imm)
+		mov_ri(RCX, val >> 8);
+	else
+		mov_rr(RCX, hi);
+	emit_store();
+	sp_offset(-2);
+	if (imm)
+		mov_ri(RCX, val & 0xFF);
+	else
+		mov_rr(RCX, lo);
+	emit_store();
+	sp_offset(-2);
+	mov_rr(GSP, RAX);
+}
+
+/* r10d = popped word, like pop() */
+void emit_pop(int idx) {
+	mov_rr(RAX, GSP);
+	emit_read(idx, 0);
+	mov_rr(R10, RCX);
+	sp_offset(1);
+	emit_read(idx, 0);
+	shift_ri(4, RCX, 8);
+	op_rr(0x09, R10, RCX);
+	sp_offset(2);
+	mov_rr(GSP, RAX);
+}
+
+/*
+ * Cycles of an instruction the JIT compiles (the not taken cycles for
+ * a conditional branch) or 0 if it is left to the interpreter.
+ */
+uint8_t jit_cycles(struct uop *u) {
+	uint8_t op = u->op[0];
+	if (op >= 0x40 && op < 0xC0) {
+		if (op == 0x76)
+			return 0;
+		return (op & 7) == 6 || (op >= 0x70 && op < 0x78) ? 8 : 4;
+	}
+	switch (op) {
+		case 0x00: case 0x2F: case 0x37: case 0x3F:
+		case 0x04: case 0x05: case 0x0C: case 0x0D:
+		case 0x14: case 0x15: case 0x1C: case 0x1D:
+		case 0x24: case 0x25: case 0x2C: case 0x2D:
+		case 0x3C: case 0x3D:
+			return 4;
+		case 0x06: case 0x0E: case 0x16: case 0x1E:
+		case 0x26: case 0x2E: case 0x3E:
+		case 0x02: case 0x0A: case 0x12: case 0x1A:
+		case 0x22: case 0x2A: case 0x32: case 0x3A:
+		case 0x03: case 0x0B: case 0x13: case 0x1B:
+		case 0x23: case 0x2B: case 0x33: case 0x3B:
+		case 0x09: case 0x19: case 0x29: case 0x39:
+		case 0x20: case 0x28: case 0x30: case 0x38:
+		case 0xC6: case 0xCE: case 0xD6: case 0xDE:
+		case 0xE6: case 0xEE: case 0xF6: case 0xFE:
+			return 8;
+		case 0x01: case 0x11: case 0x21: case 0x31:
+		case 0x34: case 0x35: case 0x36:
+		case 0x18:
+		case 0xC2: case 0xCA: case 0xD2: case 0xDA:
+		case 0xC1: case 0xD1: case 0xE1:
+			return 12;
+		case 0xE0:
+		case 0xF0:
+			// only HRAM, I/O registers are left to the interpreter
+			return u->op[1] >= 0x80 && u->op[1] != 0xFF ? 12 : 0;
+		case 0xC3: case 0xC9: case 0xEA: case 0xFA:
+		case 0xC5: case 0xD5: case 0xE5:
+			return 16;
+		case 0xCD:
+			return 24;
+	}
+	return 0;
+}
+
+/* Emits the code for uop idx, returns 1 if it ended the block */
+int emit_uop(int idx, struct uop *u) {
+	uint8_t op = u->op[0];
+	uint16_t nn = u->op[2] << 8 | u->op[1];
+	uint16_t next = uop_pc[idx + 1];
+	int dst = reg8[(op >> 3) & 7], src = reg8[op & 7];
+	int n = (op >> 4) & 3;
+	uint8_t *skip;
+
+	if (op >= 0x40 && op < 0x80) {
+		// LD r,r' / LD r,(HL) / LD (HL),r
+		if (src < 0) {
+			pair_to_eax(GH, GL);
+			emit_read(idx, 1);
+			mov_rr(dst, RCX);
+		} else if (dst < 0) {
+			pair_to_eax(GH, GL);
+			emit_write_check(idx);
+			mov_rr(RCX, src);
+			emit_store();
+		} else if (dst != src) {
+			mov_rr(dst, src);
+		}
+		return 0;
+	}
+	if (op >= 0x80 && op < 0xC0) {
+		if (src < 0) {
+			pair_to_eax(GH, GL);
+			emit_read(idx, 1);
+			src = RCX;
+		}
+		emit_alu((op >> 3) & 7, src);
+		return 0;
+	}
+
+	switch (op) {
+		case 0x00:
+			break;
+		case 0x04: case 0x0C: case 0x14: case 0x1C:
+		case 0x24: case 0x2C: case 0x3C:
+		case 0x05: case 0x0D: case 0x15: case 0x1D:
+		case 0x25: case 0x2D: case 0x3D:
+			// INC r / DEC r
+			rex(0, 0, 0, dst);
+			e8(0xFE);
+			modrm(3, op & 1, dst);
+			emit_flags(op & 1 ? HF_DEC : HF_INC);
+			break;
+		case 0x34:
+		case 0x35:
+			// INC (HL) / DEC (HL)
+			pair_to_eax(GH, GL);
+			emit_write_check(idx);
+			mov_r64i(RDX, (uint64_t)gb_mem);
+			load8_bi(RCX, RDX, RAX, 0);
+			rex(0, 0, 0, RCX);
+			e8(0xFE);
+			modrm(3, op & 1, RCX);
+			emit_flags(op & 1 ? HF_DEC : HF_INC);
+			emit_store();
+			break;
+		case 0x06: case 0x0E: case 0x16: case 0x1E:
+		case 0x26: case 0x2E: case 0x3E:
+			mov_ri(dst, u->op[1]);
+			break;
+		case 0x36:
+			pair_to_eax(GH, GL);
+			emit_write_check(idx);
+			mov_ri(RCX, u->op[1]);
+			emit_store();
+			break;
+		case 0x01: case 0x11: case 0x21: case 0x31:
+			// LD rr,nn
+			mov_ri(RAX, nn);
+			pair_set(n);
+			break;
+		case 0x03: case 0x13: case 0x23: case 0x33:
+		case 0x0B: case 0x1B: case 0x2B: case 0x3B:
+			// INC rr / DEC rr
+			pair_get(n);
+			op32_ri(op & 0x08 ? 5 : 0, RAX, 1);
+			and_eax_ffff();
+			pair_set(n);
+			break;
+		case 0x09: case 0x19: case 0x29: case 0x39:
+			// ADD HL,rr: Z kept, N cleared, H from bit 11, C from bit 15
+			pair_get(n);
+			mov_rr(RCX, RAX);
+			pair_to_eax(GH, GL);
+			mov_rr(R9, RAX);
+			op32_ri(4, R9, 0xFFF);
+			mov_rr(R10, RCX);
+			op32_ri(4, R10, 0xFFF);
+			op_rr(0x01, R9, R10);
+			op_rr(0x01, RAX, RCX);
+			op32_ri(4, GF, 0x8F);
+			shift_ri(5, R9, 7);
+			op32_ri(4, R9, FLAG_H);
+			op_rr(0x09, GF, R9);
+			mov_rr(R10, RAX);
+			shift_ri(5, R10, 12);
+			op32_ri(4, R10, FLAG_C);
+			op_rr(0x09, GF, R10);
+			and_eax_ffff();
+			eax_to_pair(GH, GL);
+			break;
+		case 0x02: case 0x12:
+			// LD (BC),A / LD (DE),A
+			pair_get(n);
+			emit_write_check(idx);
+			mov_rr(RCX, GA);
+			emit_store();
+			break;
+		case 0x0A: case 0x1A:
+			pair_get(n);
+			emit_read(idx, 1);
+			mov_rr(GA, RCX);
+			break;
+		case 0x22: case 0x32:
+			// LD (HL+),A / LD (HL-),A
+			pair_to_eax(GH, GL);
+			emit_write_check(idx);
+			mov_rr(RCX, GA);
+			emit_store();
+			pair_to_eax(GH, GL);
+			op32_ri(op == 0x32 ? 5 : 0, RAX, 1);
+			and_eax_ffff();
+			eax_to_pair(GH, GL);
+			break;
+		case 0x2A: case 0x3A:
+			pair_to_eax(GH, GL);
+			emit_read(idx, 1);
+			mov_rr(GA, RCX);
+			pair_to_eax(GH, GL);
+			op32_ri(op == 0x3A ? 5 : 0, RAX, 1);
+			and_eax_ffff();
+			eax_to_pair(GH, GL);
+			break;
+		case 0x2F:
+			// CPL
+			op8_ri(6, GA, 0xFF);
+			op8_ri(1, GF, FLAG_N | FLAG_H);
+			break;
+		case 0x37:
+			// SCF
+			op8_ri(4, GF, (uint8_t)~(FLAG_N | FLAG_H));
+			op8_ri(1, GF, FLAG_C);
+			break;
+		case 0x3F:
+			// CCF
+			op8_ri(4, GF, (uint8_t)~(FLAG_N | FLAG_H));
+			op8_ri(6, GF, FLAG_C);
+			break;
+		case 0xC6: case 0xCE: case 0xD6: case 0xDE:
+		case 0xE6: case 0xEE: case 0xF6: case 0xFE:
+			mov_ri(RCX, u->op[1]);
+			emit_alu((op >> 3) & 7, RCX);
+			break;
+		case 0xE0:
+			mov_ri(RAX, IO_PORTS + u->op[1]);
+			emit_write_check(idx);
+			mov_rr(RCX, GA);
+			emit_store();
+			break;
+		case 0xF0:
+			mov_r64i(RDX, (uint64_t)gb_mem);
+			mov_ri(RAX, IO_PORTS + u->op[1]);
+			load8_bi(GA, RDX, RAX, 0);
+			break;
+		case 0xEA:
+			mov_ri(RAX, nn);
+			emit_write_check(idx);
+			mov_rr(RCX, GA);
+			emit_store();
+			break;
+		case 0xFA:
+			mov_ri(RAX, nn);
+			emit_read(idx, 1);
+			mov_rr(GA, RCX);
+			break;
+		case 0xC5: case 0xD5: case 0xE5:
+			pair_regs(n, &dst, &src);
+			emit_push(idx, dst, src, 0, 0);
+			break;
+		case 0xC1: case 0xD1: case 0xE1:
+			emit_pop(idx);
+			mov_rr(RAX, R10);
+			pair_set(n);
+			break;
+		case 0x18:
+		case 0xC3:
+			mov_ri(R10, op == 0x18 ? (uint16_t)(next + (int8_t)u->op[1]) : nn);
+			mov_ri(R9, idx + 1);
+			to_epilogue();
+			return 1;
+		case 0x20: case 0x28: case 0x30: case 0x38:
+		case 0xC2: case 0xCA: case 0xD2: case 0xDA:
+			// conditional JR/JP: test Z (bit 3 clear) or C
+			rex(0, 0, 0, GF);
+			e8(0xF6);
+			modrm(3, 0, GF);
+			e8(op & 0x10 ? FLAG_C : FLAG_Z);
+			mov_ri(R9, idx + 1);
+			mov_ri(R10, next);
+			skip = jcc(op & 0x08 ? CC_E : CC_NE);
+			mov_ri(R10, op < 0x40 ? (uint16_t)(next + (int8_t)u->op[1]) : nn);
+			mov_ri(R9, (idx + 1) | JIT_TAKEN);
+			patch(skip, out);
+			to_epilogue();
+			return 1;
+		case 0xCD:
+			emit_push(idx, 0, 0, 1, next);
+			mov_ri(R10, nn);
+			mov_ri(R9, idx + 1);
+			to_epilogue();
+			return 1;
+		case 0xC9:
+			emit_pop(idx);
+			mov_ri(R9, idx + 1);
+			to_epilogue();
+			return 1;
+	}
+	return 0;
+}
+
+void init_host_flags() {
+	int i;
+	for (i = 0; i < 0x100; i++) {
+		host_flags[i] = (i & 0x40 ? FLAG_Z : 0) | (i & 0x10 ? FLAG_H : 0)
+			| (i & 0x01 ? FLAG_C : 0);
+	}
+}
+
+/*
+ * Compiles the instructions at the start of b that the JIT supports.
+ * Returns NULL if there are none or the code buffer is full.
+ */
+struct native_block *jit_compile(struct gb_state *state, struct block *b) {
+	static const int saved[6] = {RBX, RBP, R12, R13, R14, R15};
+	static const int regs[8] = {GA, GF, GB, GC, GD, GE, GH, GL};
+	const int offs[8] = {
+		offsetof(struct gb_state, a), offsetof(struct gb_state, f),
+		offsetof(struct gb_state, b), offsetof(struct gb_state, c),
+		offsetof(struct gb_state, d), offsetof(struct gb_state, e),
+		offsetof(struct gb_state, h), offsetof(struct gb_state, l),
+	};
+	struct native_block *nb;
+	uint8_t *epilogue;
+	int i, count, budget = 0;
+
+	if (!code_buf) {
+		code_buf = mmap(NULL, CODE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (code_buf == MAP_FAILED) {
+			code_buf = NULL;
+			return NULL;
+		}
+		code_ptr = code_buf;
+		init_host_flags();
+	}
+	if (code_buf + CODE_SIZE - code_ptr < MAX_BLOCK_CODE)
+		return NULL;
+
+	nb = (struct native_block *)code_ptr;
+	uop_pc[0] = b->pc;
+	for (count = 0; count < b->count; count++) {
+		struct uop *u = &b->uops[count];
+		uint8_t c = jit_cycles(u);
+		if (!c)
+			break;
+		nb->cycles[count] = c;
+		uop_pc[count + 1] = uop_pc[count] + u->len;
+	}
+	if (!count)
+		return NULL;
+	for (i = 0; i < count - 1; i++)
+		budget += nb->cycles[i];
+	nb->count = count;
+	nb->budget = budget;
+	switch (b->uops[count - 1].op[0]) {
+		case 0x20: case 0x28: case 0x30: case 0x38:
+			nb->taken = 12;
+			break;
+		case 0xC2: case 0xCA: case 0xD2: case 0xDA:
+			nb->taken = 16;
+			break;
+		default:
+			nb->taken = 0;
+	}
+
+	out = code_ptr + ((sizeof(struct native_block) + 15) & ~15);
+	nb->fn = (int (*)(void))out;
+	exit_count = 0;
+	epi_count = 0;
+
+	for (i = 0; i < 6; i++)
+		push_r(saved[i]);
+	rex(1, 0, 0, RSP);
+	e8(0x83);
+	modrm(3, 5, RSP);
+	e8(8);
+	mov_r64i(RAX, (uint64_t)state);
+	for (i = 0; i < 8; i++)
+		load_state(regs[i], offs[i], 0);
+	load_state(GSP, offsetof(struct gb_state, sp), 1);
+
+	for (i = 0; i < count; i++) {
+		if (emit_uop(i, &b->uops[i]))
+			break;
+	}
+	if (i == count) {
+		mov_ri(R10, uop_pc[count]);
+		mov_ri(R9, count);
+		to_epilogue();
+	}
+
+	// exits back to the interpreter, one stub per uop
+	memset(stubs, 0, sizeof(stubs));
+	for (i = 0; i < exit_count; i++) {
+		int idx = exits[i].idx;
+		if (!stubs[idx]) {
+			stubs[idx] = out;
+			mov_ri(R10, uop_pc[idx]);
+			mov_ri(R9, idx);
+			to_epilogue();
+		}
+		patch(exits[i].at, stubs[idx]);
+	}
+
+	epilogue = out;
+	mov_r64i(RAX, (uint64_t)state);
+	for (i = 0; i < 8; i++)
+		store_state(regs[i], offs[i], 0);
+	store_state(GSP, offsetof(struct gb_state, sp), 1);
+	store_state(R10, offsetof(struct gb_state, pc), 1);
+	mov_rr(RAX, R9);
+	rex(1, 0, 0, RSP);
+	e8(0x83);
+	modrm(3, 0, RSP);
+	e8(8);
+	for (i = 5; i >= 0; i--)
+		pop_r(saved[i]);
+	e8(0xC3);
+	for (i = 0; i < epi_count; i++)
+		patch(epi_fix[i].at, epilogue);
+
+	code_ptr = (uint8_t *)(((uintptr_t)out + 15) & ~(uintptr_t)15);
+	return nb;
+}
+
+/*
+ * Drops all compiled code. Only called together with flush_blocks()
+ * since blocks point into the code buffer.
+ */
+void jit_reset() {
+	if (code_buf)
+		code_ptr = code_buf;
+}
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include <stdint.h>
+
+#include "block.h"
+#include "cpu.h"
+
+/* Times a ROM block runs in the interpreter before it is compiled */
+#define JIT_THRESHOLD 16
+
+/* Set in the count fn returns when its final conditional branch is taken */
+#define JIT_TAKEN 0x100
+
+/*
+ * x86-64 code for the first count uops of a block. fn runs them with
+ * the guest registers held in host registers and returns how many
+ * instructions it finished, or'd with JIT_TAKEN when the last one is
+ * a conditional branch that was taken. It returns early, with PC at the
+ * instruction, when an instruction needs the interpreter (I/O,
+ * VRAM, OAM, external RAM or a write to cached code).
+ * cycles holds the cycles of each uop, taken those of the last uop
+ * when it is a conditional branch that is taken (0 if it is not
+ * conditional) and budget the cycles clocked before the last uop runs.
+ */
+struct native_block {
+	int (*fn)(void);
+	uint8_t count;
+	uint8_t taken;
+	uint16_t budget;
+	uint8_t cycles[MAX_BLOCK_OPS];
+};
+
+struct native_block *jit_compile(struct gb_state *state, struct block *b);
+void jit_reset();
+
+#endif
@@ -6,6 +6,10 @@
 #include "mem.h"
 #include "display.h"
 #include "input.h"
+#include "block.h"
+#include "gpu.h"
+#include "cpu.h"
+#include "sched.h"
 
 #define DMA_SIZE 0xA0
 
@@ -36,24 +40,160 @@ time_t last_rtc = 0;
 void latch_rtc() {
 }
 
-uint8_t *get_mem_ptr(uint16_t addr) {
-	// if accessing ROM bank memory, select from appropriate bank
-	if (mbd.mbc != NO_MBC && addr >= 0x4000 && addr < 0x8000
-		&& mbd.rom_idx < mbd.rom_count) {
-		return &mbd.rom_banks[mbd.rom_idx][addr - 0x4000];
+/*
+ * Host memory behind each 256 byte page of the address space. A read
+ * or write of a page with an entry is a plain load or store, one
+ * without goes through get_io or the rest of set_mem. Only the
+ * switchable ROM bank and the external RAM change mapping, so only
+ * their pages are updated when the MBC registers are written.
+ */
+uint8_t *read_page[0x100];
+uint8_t *write_page[0x100];
+
+/*
+ * Returns the external RAM behind addr in 0xA000-0xBFFF or NULL if
+ * none is enabled there. Writes go to the selected RAM bank even
+ * while an MBC3 RTC register is selected, reads do not.
+ */
+uint8_t *ext_ram_ptr(uint16_t addr) {
+	if (!mbd.ram_rw || !mbd.ram_count || mbd.ram_idx >= mbd.ram_count)
+		return NULL;
+	if (addr >= 0xA800 && mbd.ram_size == 0x800)
+		return NULL;
+	return &mbd.ram_banks[mbd.ram_idx][addr - 0xA000];
+}
+
+/*
+ * Points the pages of the switchable ROM bank and external RAM at
+ * the selected banks.
+ */
+void map_banks() {
+	int i;
+	uint8_t *ram;
+	for (i = SW16_ROM_BANK >> 8; i < VIDEO_RAM >> 8; i++) {
+		if (mbd.mbc != NO_MBC && mbd.rom_idx < mbd.rom_count)
+			read_page[i] = &mbd.rom_banks[mbd.rom_idx][(i << 8) - SW16_ROM_BANK];
+		else
+			read_page[i] = &gb_mem[i << 8];
 	}
-	if (addr >= 0xA000 && addr < 0xC000 && mbd.ram_rw) {
-		if (mbd.rtc) {
-		} else if (mbd.ram_count && (addr < 0xA800 || mbd.ram_size != 0x800)
-			&& mbd.ram_idx < mbd.ram_count) {
-			return &mbd.ram_banks[mbd.ram_idx][addr - 0xA000];
-		}
+	for (i = SW8_ROM_BANK >> 8; i < INTERNAL_RAM0 >> 8; i++) {
+		ram = ext_ram_ptr(i << 8);
+		read_page[i] = ram && !mbd.rtc ? ram : &gb_mem[i << 8];
+		write_page[i] = ram;
 	}
+}
+
+/*
+ * Sends writes to the WRAM page and its echo through set_mem while
+ * watch is set, because cached code there has to be dropped when it
+ * changes, and straight to memory otherwise. Called by block.c.
+ */
+void watch_writes(uint8_t page, int watch) {
+	uint8_t *p = watch ? NULL : &gb_mem[page << 8];
+	if (page < INTERNAL_RAM0 >> 8 || page >= ECHO_RAM >> 8)
+		return;
+	write_page[page] = p;
+	if (page + (ECHO_OFFSET >> 8) < OAM >> 8)
+		write_page[page + (ECHO_OFFSET >> 8)] = p;
+}
+
+/*
+ * Fills the page tables once gb_mem is allocated. Everything but I/O
+ * and HRAM is read straight from memory and echo RAM is the same
+ * memory as 0xC000-0xDDFF. Writes to ROM, VRAM, OAM and I/O all have
+ * side effects, so only external RAM and WRAM without cached code are
+ * written directly.
+ */
+void map_pages() {
+	int i;
+	for (i = 0; i < 0x100; i++) {
+		read_page[i] = &gb_mem[i << 8];
+		write_page[i] = NULL;
+	}
+	for (i = ECHO_RAM >> 8; i < OAM >> 8; i++)
+		read_page[i] = &gb_mem[(i << 8) - ECHO_OFFSET];
+	for (i = INTERNAL_RAM0 >> 8; i < ECHO_RAM >> 8; i++)
+		watch_writes(i, 0);
+	read_page[IO_PORTS >> 8] = NULL;
+	map_banks();
+}
+
+uint8_t *get_mem_ptr(uint16_t addr) {
+	uint8_t *page = read_page[addr >> 8];
+	if (page)
+		return &page[addr & 0xFF];
 	return &gb_mem[addr];
 }
 
+/*
+ * The I/O page is the only one without an entry. HRAM in it has no
+ * component to catch up so it is read directly too.
+ */
 uint8_t get_mem(uint16_t addr) {
-	return *get_mem_ptr(addr);
+	uint8_t *page = read_page[addr >> 8];
+	if (page)
+		return page[addr & 0xFF];
+	if (addr >= INTERNAL_RAM1 && addr < IE)
+		return gb_mem[addr];
+	return get_io(addr - IO_PORTS);
+}
+
+/*
+ * Reads the little endian word at addr. When both bytes are in the
+ * same page of the table or in HRAM they are loaded directly, else
+ * they are read one at a time.
+ */
+uint16_t read16(uint16_t addr) {
+	uint8_t *page = read_page[addr >> 8];
+	uint8_t i = addr & 0xFF;
+	if (!page && addr >= INTERNAL_RAM1)
+		page = &gb_mem[IO_PORTS];
+	if (page && i != 0xFF)
+		return page[i] | page[i + 1] << 8;
+	return get_mem(addr) | get_mem(addr + 1) << 8;
+}
+
+/*
+ * Writes the little endian word val at addr, the high byte first
+ * when it has to go through set_mem as PUSH does. HRAM without cached
+ * code is written directly like the pages of the table.
+ */
+void write16(uint16_t addr, uint16_t val) {
+	uint8_t *page = write_page[addr >> 8];
+	uint8_t i = addr & 0xFF;
+	if (!page && addr >= INTERNAL_RAM1 && addr < IE - 1
+		&& !code_refs[addr] && !code_refs[addr + 1])
+		page = &gb_mem[IO_PORTS];
+	if (page && i != 0xFF) {
+		page[i] = val & 0xFF;
+		page[i + 1] = val >> 8;
+		return;
+	}
+	set_mem(addr + 1, val >> 8);
+	set_mem(addr, val & 0xFF);
+}
+
+/*
+ * Reads the I/O register or HRAM byte at IO_PORTS + port. The
+ * component that owns it is caught up first.
+ */
+uint8_t get_io(uint8_t port) {
+	if (io_owner[port])
+		sync_component(io_owner[port]);
+	return gb_mem[IO_PORTS + port];
+}
+
+uint8_t get_rom_bank() {
+	return mbd.rom_idx;
+}
+
+/*
+ * Maps ROM bank index bank at 0x4000-0x7FFF without going through
+ * the MBC registers. Used to read every bank when recompiling.
+ */
+void set_rom_bank(uint8_t bank) {
+	mbd.rom_idx = bank;
+	map_banks();
 }
 
 void dma(uint8_t addr) {
@@ -76,6 +216,7 @@ void mbc3_set_mem(uint16_t dest, uint8_t data) {
 	}
 	else if (dest >= 0x2000 && dest < 0x4000) {
 		mbd.rom_idx = data & 0x7F;
+		select_block_bank(mbd.rom_idx);
 	}
 	else if (dest >= 0x4000 && dest < 0x6000) {
 		if (data >= 0x08 && data <= 0x0C) {
@@ -106,6 +247,7 @@ void mbc1_set_mem(uint16_t dest, uint8_t data) {
 		}	
 		if (mbd.rom_idx >= mbd.rom_count)
 			printf("%04X vs %04X\n", mbd.rom_idx, mbd.rom_count);
+		select_block_bank(mbd.rom_idx);
 	}
 	else if (dest >= 0x4000 && dest < 0x6000) {
 		if (mbd.mode == ROM_MODE) {
@@ -121,6 +263,7 @@ void mbc1_set_mem(uint16_t dest, uint8_t data) {
 				printf("B: %04X apply %04X\n", pi, data);
 				printf("%04X vs %04X\n", mbd.rom_idx, mbd.rom_count);
 			}
+			select_block_bank(mbd.rom_idx);
 		} else {
 			mbd.ram_idx = data & 0x3;
 			if (mbd.ram_idx >= mbd.ram_count)
@@ -129,70 +272,162 @@ void mbc1_set_mem(uint16_t dest, uint8_t data) {
 	}
 }
 
+/*
+ * Handlers for writes to the I/O registers at 0xFF00-0xFF7F that have
+ * side effects. Registers without one are plain stores.
+ */
+void write_joypad(uint16_t dest, uint8_t data) {
+	// writing to 0xFF00 requests button input info
+	uint8_t p15 = data & 0x20;
+	uint8_t p14 = data & 0x10;
+	if (!p14 || !p15) {
+		int f = p15 == 0;
+		uint8_t res = request_input(f);
+		data = (data & 0xF0) | res;
+	}
+	gb_mem[dest] = data;
+}
+
+void write_timer(uint16_t dest, uint8_t data) {
+	// DIV and TIMA are counted up to the write, TAC with its old value
+	sync_component(COMP_TIMER);
+	gb_mem[dest] = data;
+	timers_written();
+}
+
+void write_if(uint16_t dest, uint8_t data) {
+	sync_component(COMP_GPU);
+	gb_mem[dest] = data;
+	update_interrupts();
+}
+
+/* The GPU draws with these, so it has to catch up to the write first */
+void write_gpu_reg(uint16_t dest, uint8_t data) {
+	sync_component(COMP_GPU);
+	gb_mem[dest] = data;
+}
+
+void write_lcdc(uint16_t dest, uint8_t data) {
+	uint8_t bit7 = data >> 7;
+	uint8_t old_bit7 = gb_mem[LCDC] >> 7;
+	sync_component(COMP_GPU);
+	// Setting 7th bit in LCDC sets LY = 0
+	// TODO: this may actually be false despite docs
+	if (bit7 != old_bit7) {
+		gb_mem[LY] = 0;
+		lcd_switched(bit7);
+	}
+	gb_mem[dest] = data;
+}
+
+void write_stat(uint16_t dest, uint8_t data) {
+	sync_component(COMP_GPU);
+	gb_mem[dest] = data;
+	gpu_reschedule();
+}
+
+void write_ly(uint16_t dest, uint8_t data) {
+	sync_component(COMP_GPU);
+	gb_mem[dest] = 0;
+}
+
+void write_dma(uint16_t dest, uint8_t data) {
+	sync_component(COMP_GPU);
+	gb_mem[dest] = data;
+	// writes to FF46 initiate a DMA transfer at the given start address
+	if (data <= 0xF1)
+		dma(data);
+}
+
+void (*const io_write[0x80])(uint16_t dest, uint8_t data) = {
+	[0x00] = write_joypad,
+	[DIV - IO_PORTS] = write_timer,
+	[TIMA - IO_PORTS] = write_timer,
+	[TMA - IO_PORTS] = write_timer,
+	[TAC - IO_PORTS] = write_timer,
+	[IF - IO_PORTS] = write_if,
+	[LCDC - IO_PORTS] = write_lcdc,
+	[STAT - IO_PORTS] = write_stat,
+	[SCY - IO_PORTS] = write_gpu_reg,
+	[SCX - IO_PORTS] = write_gpu_reg,
+	[LY - IO_PORTS] = write_ly,
+	[LYC - IO_PORTS] = write_gpu_reg,
+	[DMA - IO_PORTS] = write_dma,
+	[BGP - IO_PORTS] = write_gpu_reg,
+	[OBP0 - IO_PORTS] = write_gpu_reg,
+	[OBP1 - IO_PORTS] = write_gpu_reg,
+	[WY - IO_PORTS] = write_gpu_reg,
+	[WX - IO_PORTS] = write_gpu_reg,
+};
+
 void set_mem(uint16_t dest, uint8_t data) {
+	uint8_t *page = write_page[dest >> 8];
+	if (page) {
+		page[dest & 0xFF] = data;
+		return;
+	}
+
+	// HRAM only needs code cached from it dropped
+	if (dest >= INTERNAL_RAM1 && dest < IE) {
+		gb_mem[dest] = data;
+		if (code_refs[dest])
+			invalidate_code(dest);
+		return;
+	}
+
 	// Writes to ROM are instead used to set MBC based options
 	if (dest < 0x8000) {
 		if (mbd.mbc == MBC1)
 			mbc1_set_mem(dest, data);
 		else if (mbd.mbc == MBC3)
 			mbc3_set_mem(dest, data);
+		map_banks();
 		return;
 	}
 
-	if (dest >= 0xA000 && dest < 0xC000) {
-		if (mbd.ram_count && (dest < 0xA800 || mbd.ram_size != 0x800)
-				&& mbd.ram_rw && mbd.ram_idx < mbd.ram_count)
-			mbd.ram_banks[mbd.ram_idx][dest - 0xA000] = data;
+	// external RAM that is not mapped ignores writes
+	if (dest >= 0xA000 && dest < 0xC000)
 		return;
-	}
 
-	// STAT register limits access to OAM and VRAM based on the LCD mode
-	struct statr *stat = get_stat();
-	struct lcdc *lcdc = get_lcdc();
-	if (dest >= 0x8000 && dest <= 0x9FFF && stat->mode_flag == 0x03 && lcdc->lcd_control_op)
-		return;
-	if (dest >= 0xFE00 && dest <= 0xFE9F && stat->mode_flag > 0x01 && lcdc->lcd_control_op)
-		return;
+	// 0xE000-0xFDFF is the same memory as 0xC000-0xDDFF
+	if (dest >= ECHO_RAM && dest < OAM)
+		dest -= ECHO_OFFSET;
 
-	// writing to 0xFF00 requests button input info
-	if (dest == 0xFF00) {
-		uint8_t p15 = data & 0x20;
-		uint8_t p14 = data & 0x10;
-		if (!p14 || !p15) {
-			int f = p15 == 0;
-			uint8_t res = request_input(f);
-			uint8_t r = f ? (data & 0xF0) | res : (data & 0xF0) | res;
-			gb_mem[0xFF00] = r;
-			return;
-		}
+	if (dest >= IO_PORTS && dest < INTERNAL_RAM1) {
+		if (io_write[dest - IO_PORTS])
+			io_write[dest - IO_PORTS](dest, data);
+		else
+			gb_mem[dest] = data;
+		return;
 	}
 
-	// Setting 7th bit in LCDC sets LY = 0
-	// TODO: this may actually be false despite docs
-	if (dest == LCDC) {
-		uint8_t bit7 = data >> 7;
-		uint8_t old_bit7 = gb_mem[LCDC] >> 7;
-		if (bit7 != old_bit7) {
-			gb_mem[LY] = 0;
-		}
+	if (dest == IE) {
+		sync_component(COMP_GPU);
+		gb_mem[dest] = data;
+		gpu_reschedule();
+		update_interrupts();
+		return;
 	}
 
-	if (dest == LY)
-		data = 0;
+	// STAT register limits access to OAM and VRAM based on the LCD mode
+	if (dest < SW8_ROM_BANK || (dest >= OAM && dest < 0xFEA0)) {
+		sync_component(COMP_GPU);
+		struct statr *stat = get_stat();
+		struct lcdc *lcdc = get_lcdc();
+		if (dest < SW8_ROM_BANK && stat->mode_flag == 0x03 && lcdc->lcd_control_op)
+			return;
+		if (dest >= OAM && stat->mode_flag > 0x01 && lcdc->lcd_control_op)
+			return;
+	}
 
 	gb_mem[dest] = data;
 
-	// writes to 0xC000-0xDDFF are mirrored at 0xE000-0xFE00 and vice versa
-	if (dest >= INTERNAL_RAM0 && dest <= 0xDDFF) {
-		gb_mem[dest + ECHO_OFFSET] = data;
-	} else if (dest >= ECHO_RAM && dest <= 0xFDFF) {
-		gb_mem[dest - ECHO_OFFSET] = data;
-	}
-
-	// writes to FF46 initiate a DMA transfer at the given start address
-	if (dest == DMA && data <= 0xF1) {
-		dma(data);
-	}
+	// the GPU decodes the tile again when it next draws it
+	if (dest >= VIDEO_RAM && dest < BG_MAP_DATA0)
+		tile_written(dest);
+	// drop cached blocks decoded from the old code
+	if (code_refs[dest])
+		invalidate_code(dest);
 	// TODO: look at specifics of some special registers
 }
 
@@ -339,22 +574,6 @@ struct sprite_attr *get_sprite_attr(int index) {
 	return (struct sprite_attr *)&gb_mem[OAM + index * 4];
 }
 
-uint8_t *get_sprite_data(uint8_t index, int bg) {
-	int size = 16;
-	if (get_lcdc()->obj_size && !bg) {
-		index &= 0xFE;
-	}
-	return &gb_mem[SPRITE_TILES + (uint8_t)index * size];
-}
-
-uint8_t *get_tile_data(uint8_t index, int size, int bg_tile_sel) {
-	if (bg_tile_sel) {
-		return &gb_mem[SPRITE_TILES + (uint8_t)index * size];
-	} else {
-		return &gb_mem[0x9000 + (int8_t)index * size];
-	}
-}
-
 /*
  * Set's the stat mode and starts an interrupt if the appropriate
  * STAT flag is set.
@@ -365,11 +584,11 @@ void set_stat_mode(uint8_t mode) {
 		return;
 	gb_mem[STAT] = (gb_mem[STAT] & 0xFC) | mode;
 	if (gb_mem[STAT] & 0x8 && mode == 0) {
-		gb_mem[IF] |= 0x2;
+		request_interrupt(0x2);
 	} else if (gb_mem[STAT] & 0x10 && mode == 0x01) {
-		gb_mem[IF] |= 0x2;
+		request_interrupt(0x2);
 	} else if (gb_mem[STAT] & 0x20 && mode == 0x10) {
-		gb_mem[IF] |= 0x2;
+		request_interrupt(0x2);
 	}
 }
 
@@ -379,7 +598,7 @@ void set_ly(uint8_t val) {
 	if (val == gb_mem[LYC]) {
 		gb_mem[STAT] |= 0x4;
 		if (gb_mem[STAT] & 0x40) {
-			gb_mem[IF] |= 0x2;
+			request_interrupt(0x2);
 		}
 	} else {
 		gb_mem[STAT] &= 0xFB;
@@ -133,13 +133,11 @@ struct lcdc *get_lcdc();
 struct statr *get_stat();
 struct interrupt_flag *get_if();
 
-uint8_t *get_sprite_data(uint8_t index, int bg);
-uint8_t *get_tile_data(uint8_t index, int size, int obj_tiles);
-
 void set_ly(uint8_t val);
 void set_stat_mode(uint8_t mode);
 
 uint8_t *gb_mem;
+extern uint8_t *read_page[0x100];
 
 /* 
  * All CPU based memory writing must go through set_mem and all
@@ -150,7 +148,14 @@ uint8_t *gb_mem;
  */
 void set_mem(uint16_t dest, uint8_t data);
 uint8_t get_mem(uint16_t addr);
+uint8_t get_io(uint8_t port);
+uint16_t read16(uint16_t addr);
+void write16(uint16_t addr, uint16_t val);
 uint8_t *get_mem_ptr(uint16_t addr);
+void map_pages();
+void watch_writes(uint8_t page, int watch);
+uint8_t get_rom_bank();
+void set_rom_bank(uint8_t bank);
 
 void setup_mem_banks(uint8_t* cart_mem, char* name);
 void save_ram();
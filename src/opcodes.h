@@ -0,0 +1,1196 @@
+/*
+ * Opcode handlers shared by the CPU cores in cpu.c. This file is
+ * included once per core so it has no include guard. The including
+ * core defines OP(n) to start the handler for opcode n, NEXT to end
+ * it and CB_PREFIX to run a 0xCB prefixed instruction.
+ * Handlers may use state, regs, op, nn, tmp, pc and cycles. The
+ * registers and flags are reached through regs, which the core points
+ * either at state or at a local copy it keeps them in, and everything
+ * else through state.
+ */
+
+OP(0x00)
+	/* NOP */
+	NEXT;
+OP(0x01)
+	/* LD BC,nn */
+	regs->c = op[1];
+	regs->b = op[2];
+	cycles = 12;
+	regs->pc += 2;
+	NEXT;
+OP(0x02)
+	/* LD (BC),A */
+	write_mem(state, regs, regs->bc, regs->a);
+	cycles = 8;
+	NEXT;
+OP(0x03)
+	/* INC BC */
+	regs->bc++;
+	cycles = 8;
+	NEXT;
+OP(0x04)
+	/* INC B */
+	set_add8_flags(regs, regs->b, 1, 0);
+	regs->b++;
+	NEXT;
+OP(0x05)
+	/* DEC B */
+	set_sub8_flags(regs, regs->b, 1, 0);
+	regs->b--;
+	NEXT;
+OP(0x06)
+	/* LD B,n */
+	cycles = load8val2reg(regs, &regs->b, op[1]);
+	NEXT;
+OP(0x07)
+	/* RLCA */
+	rot_left_carry(regs, &regs->a);
+	sync_flags(regs);
+	regs->fz = 0;
+	NEXT;
+OP(0x08)
+	/* LD (nn),SP */
+	write_mem(state, regs, nn, (uint8_t)(regs->sp & 0xFF));
+	write_mem(state, regs, nn+1, (uint8_t)(regs->sp >> 8));
+	regs->pc += 2;
+	cycles = 20;
+	NEXT;
+OP(0x09)
+	/* ADD HL,BC */
+	set_add16_flags(regs, regs->hl, regs->bc);
+	regs->hl += regs->bc;
+	cycles = 8;
+	NEXT;
+OP(0x0A)
+	/* LD A,(BC) */
+	regs->a = get_mem(regs->bc);
+	cycles = 8;
+	NEXT;
+OP(0x0B)
+	/* DEC BC */
+	regs->bc--;
+	cycles = 8;
+	NEXT;
+OP(0x0C)
+	/* INC C */
+	set_add8_flags(regs, regs->c++, 1, 0);
+	NEXT;
+OP(0x0D)
+	/* DEC C */
+	set_sub8_flags(regs, regs->c--, 1, 0);
+	NEXT;
+OP(0x0E)
+	/* LD C,n */
+	cycles = load8val2reg(regs, &regs->c, op[1]);
+	NEXT;
+OP(0x0F)
+	/* RRCA */
+	rot_right_carry(regs, &regs->a);
+	sync_flags(regs);
+	regs->fz = 0;
+	NEXT;
+OP(0x10)
+	/* STOP 0 */
+	//fprintf(stderr, "%04X: STOP 0 not implemented\n", regs->pc);
+	regs->pc++;
+	NEXT;
+OP(0x11)
+	/* LD DE,nn */
+	regs->e = op[1];
+	regs->d = op[2];
+	cycles = 12;
+	regs->pc += 2;
+	NEXT;
+OP(0x12)
+	/* LD (DE),A */
+	write_mem(state, regs, regs->de, regs->a);
+	cycles = 8;
+	NEXT;
+OP(0x13)
+	/* INC DE */
+	regs->de++;
+	cycles = 8;
+	NEXT;
+OP(0x14)
+	/* INC D */
+	set_add8_flags(regs, regs->d++, 1, 0);
+	NEXT;
+OP(0x15)
+	/* DEC D */
+	set_sub8_flags(regs, regs->d--, 1, 0);
+	NEXT;
+OP(0x16)
+	/* LD D,n */
+	cycles = load8val2reg(regs, &regs->d, op[1]);
+	NEXT;
+OP(0x17)
+	/* RLA */
+	rot_left(regs, &regs->a);
+	sync_flags(regs);
+	regs->fz = 0;
+	NEXT;
+OP(0x18)
+	/* JR n */
+	regs->pc += 1 + (int8_t)op[1];
+	cycles = 12;
+	NEXT;
+OP(0x19)
+	/* ADD HL,DE */
+	set_add16_flags(regs, regs->hl, regs->de);
+	regs->hl += regs->de;
+	cycles = 8;
+	NEXT;
+OP(0x1A)
+	/* LD A,(DE) */
+	regs->a = get_mem(regs->de);
+	cycles = 8;
+	NEXT;
+OP(0x1B)
+	/* DEC DE */
+	regs->de--;
+	cycles = 8;
+	NEXT;
+OP(0x1C)
+	/* INC E */
+	set_add8_flags(regs, regs->e++, 1, 0);
+	NEXT;
+OP(0x1D)
+	/* DEC E */
+	set_sub8_flags(regs, regs->e--, 1, 0);
+	NEXT;
+OP(0x1E)
+	/* LD E,n */
+	cycles = load8val2reg(regs, &regs->e, op[1]);
+	NEXT;
+OP(0x1F)
+	/* RRA */
+	rot_right(regs, &regs->a);
+	sync_flags(regs);
+	regs->fz = 0;
+	NEXT;
+OP(0x20)
+	/* JR NZ,n */
+	regs->pc++;
+	cycles = 8;
+	if (!flag_z(regs)) {
+		regs->pc += (int8_t)op[1];
+		cycles = 12;
+	}
+	NEXT;
+OP(0x21)
+	/* LD HL,nn */
+	regs->l = op[1];
+	regs->h = op[2];
+	cycles = 12;
+	regs->pc += 2;
+	NEXT;
+OP(0x22)
+	/* LD (HL+),A */
+	write_mem(state, regs, regs->hl++, regs->a);
+	cycles = 8;
+	NEXT;
+OP(0x23)
+	/* INC HL */
+	regs->hl++;
+	cycles = 8;
+	NEXT;
+OP(0x24)
+	/* INC H */
+	set_add8_flags(regs, regs->h++, 1, 0);
+	NEXT;
+OP(0x25)
+	/* DEC H */
+	set_sub8_flags(regs, regs->h--, 1, 0);
+	NEXT;
+OP(0x26)
+	/* LD H,n */
+	cycles = load8val2reg(regs, &regs->h, op[1]);
+	NEXT;
+OP(0x27)
+	/* DAA */
+	daa(regs);
+	NEXT;
+OP(0x28)
+	/* JR Z,n */
+	regs->pc++;
+	cycles = 8;
+	if (flag_z(regs)) {
+		regs->pc += (int8_t)op[1];
+		cycles = 12;
+	}
+	NEXT;
+OP(0x29)
+	/* ADD HL,HL */
+	set_add16_flags(regs, regs->hl, regs->hl);
+	regs->hl += regs->hl;
+	cycles = 8;
+	NEXT;
+OP(0x2A)
+	/* LD A,(HL+) */
+	regs->a = get_mem(regs->hl++);
+	cycles = 8;
+	NEXT;
+OP(0x2B)
+	/* DEC HL */
+	regs->hl--;
+	cycles = 8;
+	NEXT;
+OP(0x2C)
+	/* INC L */
+	set_add8_flags(regs, regs->l++, 1, 0);
+	NEXT;
+OP(0x2D)
+	/* DEC L */
+	set_sub8_flags(regs, regs->l--, 1, 0);
+	NEXT;
+OP(0x2E)
+	/* LD L,n */
+	cycles = load8val2reg(regs, &regs->l, op[1]);
+	NEXT;
+OP(0x2F)
+	/* CPL */
+	regs->a = ~regs->a;
+	sync_flags(regs);
+	regs->fn = 1;
+	regs->fh = 1;
+	NEXT;
+OP(0x30)
+	/* JR NC,n */
+	regs->pc++;
+	cycles = 8;
+	if (!flag_c(regs)) {
+		cycles = 12;
+		regs->pc += (int8_t)op[1];
+	}
+	NEXT;
+OP(0x31)
+	/* LD SP,nn */
+	regs->sp = nn;
+	cycles = 12;
+	regs->pc += 2;
+	NEXT;
+OP(0x32)
+	/* LD (HL-),A */
+	write_mem(state, regs, regs->hl--, regs->a);
+	cycles = 8;
+	NEXT;
+OP(0x33)
+	/* INC SP */
+	regs->sp++;
+	cycles = 8;
+	NEXT;
+OP(0x34)
+	/* INC (HL) */
+	tmp = get_mem(regs->hl);
+	set_add8_flags(regs, tmp++, 1, 0);
+	write_mem(state, regs, regs->hl, tmp);
+	cycles = 12;
+	NEXT;
+OP(0x35)
+	/* DEC (HL) */
+	tmp = get_mem(regs->hl);
+	set_sub8_flags(regs, tmp--, 1, 0);
+	write_mem(state, regs, regs->hl, tmp);
+	cycles = 12;
+	NEXT;
+OP(0x36)
+	/* LD (HL),n */
+	write_mem(state, regs, regs->hl, op[1]);
+	regs->pc++;
+	cycles = 12;
+	NEXT;
+OP(0x37)
+	/* SCF */
+	sync_flags(regs);
+	regs->fc = 1;
+	regs->fn = 0;
+	regs->fh = 0;
+	NEXT;
+OP(0x38)
+	/* JR C,n */
+	regs->pc++;
+	cycles = 8;
+	if (flag_c(regs)) {
+		cycles = 12;
+		regs->pc += (int8_t)op[1];
+	}
+	NEXT;
+OP(0x39)
+	/* ADD HL,SP */
+	set_add16_flags(regs, regs->hl, regs->sp);
+	regs->hl += regs->sp;
+	cycles = 8;
+	NEXT;
+OP(0x3A)
+	/* LD A,(HL-) */
+	regs->a = get_mem(regs->hl);
+	cycles = 8;
+	regs->hl--;
+	NEXT;
+OP(0x3B)
+	/* DEC SP */
+	regs->sp--;
+	cycles = 8;
+	NEXT;
+OP(0x3C)
+	/* INC A */
+	set_add8_flags(regs, regs->a++, 1, 0);
+	NEXT;
+OP(0x3D)
+	/* DEC A */
+	set_sub8_flags(regs, regs->a--, 1, 0);
+	NEXT;
+OP(0x3E)
+	/* LD A,n */
+	cycles = load8val2reg(regs, &regs->a, op[1]);
+	NEXT;
+OP(0x3F)
+	/* CCF */
+	sync_flags(regs);
+	regs->fc = !regs->fc;
+	regs->fn = 0;
+	regs->fh = 0;
+	NEXT;
+OP(0x40)
+	/* LD B,B */
+	regs->b = regs->b;
+	NEXT;
+OP(0x41)
+	/* LD B,C */
+	regs->b = regs->c;
+	NEXT;
+OP(0x42)
+	/* LD B,D */
+	regs->b = regs->d;
+	NEXT;
+OP(0x43)
+	/* LD B,E */
+	regs->b = regs->e;
+	NEXT;
+OP(0x44)
+	/* LD B,H */
+	regs->b = regs->h;
+	NEXT;
+OP(0x45)
+	/* LD B,L */
+	regs->b = regs->l;
+	NEXT;
+OP(0x46)
+	/* LD B,(HL) */
+	regs->b = get_mem(regs->hl);
+	cycles = 8;
+	NEXT;
+OP(0x47)
+	/* LD B,A */
+	regs->b = regs->a;
+	NEXT;
+OP(0x48)
+	/* LD C,B */
+	regs->c = regs->b;
+	NEXT;
+OP(0x49)
+	/* LD C,C */
+	regs->c = regs->c;
+	NEXT;
+OP(0x4A)
+	/* LD C,D */
+	regs->c = regs->d;
+	NEXT;
+OP(0x4B)
+	/* LD C,E */
+	regs->c = regs->e;
+	NEXT;
+OP(0x4C)
+	/* LD C,H */
+	regs->c = regs->h;
+	NEXT;
+OP(0x4D)
+	/* LD C,L */
+	regs->c = regs->l;
+	NEXT;
+OP(0x4E)
+	/* LD C,(HL) */
+	regs->c = get_mem(regs->hl);
+	cycles = 8;
+	NEXT;
+OP(0x4F)
+	/* LD C,A */
+	regs->c = regs->a;
+	NEXT;
+OP(0x50)
+	/* LD D,B */
+	regs->d = regs->b;
+	NEXT;
+OP(0x51)
+	/* LD D,C */
+	regs->d = regs->c;
+	NEXT;
+OP(0x52)
+	/* LD D,D */
+	regs->d = regs->d;
+	NEXT;
+OP(0x53)
+	/* LD D,E */
+	regs->d = regs->e;
+	NEXT;
+OP(0x54)
+	/* LD D,H */
+	regs->d = regs->h;
+	NEXT;
+OP(0x55)
+	/* LD D,L */
+	regs->d = regs->l;
+	NEXT;
+OP(0x56)
+	/* LD D,(HL) */
+	regs->d = get_mem(regs->hl);
+	cycles = 8;
+	NEXT;
+OP(0x57)
+	/* LD D,A */
+	regs->d = regs->a;
+	NEXT;
+OP(0x58)
+	/* LD E,B */
+	regs->e = regs->b;
+	NEXT;
+OP(0x59)
+	/* LD E,C */
+	regs->e = regs->c;
+	NEXT;
+OP(0x5A)
+	/* LD E,D */
+	regs->e = regs->d;
+	NEXT;
+OP(0x5B)
+	/* LD E,E */
+	regs->e = regs->e;
+	NEXT;
+OP(0x5C)
+	/* LD E,H */
+	regs->e = regs->h;
+	NEXT;
+OP(0x5D)
+	/* LD E,L */
+	regs->e = regs->l;
+	NEXT;
+OP(0x5E)
+	/* LD E,(HL) */
+	regs->e = get_mem(regs->hl);
+	cycles = 8;
+	NEXT;
+OP(0x5F)
+	/* LD E,A */
+	regs->e = regs->a;
+	NEXT;
+OP(0x60)
+	/* LD H,B */
+	regs->h = regs->b;
+	NEXT;
+OP(0x61)
+	/* LD H,C */
+	regs->h = regs->c;
+	NEXT;
+OP(0x62)
+	/* LD H,D */
+	regs->h = regs->d;
+	NEXT;
+OP(0x63)
+	/* LD H,E */
+	regs->h = regs->e;
+	NEXT;
+OP(0x64)
+	/* LD H,H */
+	regs->h = regs->h;
+	NEXT;
+OP(0x65)
+	/* LD H,L */
+	regs->h = regs->l;
+	NEXT;
+OP(0x66)
+	/* LD H,(HL) */
+	regs->h = get_mem(regs->hl);
+	cycles = 8;
+	NEXT;
+OP(0x67)
+	/* LD H,A */
+	regs->h = regs->a;
+	NEXT;
+OP(0x68)
+	/* LD L,B */
+	regs->l = regs->b;
+	NEXT;
+OP(0x69)
+	/* LD L,C */
+	regs->l = regs->c;
+	NEXT;
+OP(0x6A)
+	/* LD L,D */
+	regs->l = regs->d;
+	NEXT;
+OP(0x6B)
+	/* LD L,E */
+	regs->l = regs->e;
+	NEXT;
+OP(0x6C)
+	/* LD L,H */
+	regs->l = regs->h;
+	NEXT;
+OP(0x6D)
+	/* LD L,L */
+	regs->l = regs->l;
+	NEXT;
+OP(0x6E)
+	/* LD L,(HL) */
+	regs->l = get_mem(regs->hl);
+	cycles = 8;
+	NEXT;
+OP(0x6F)
+	/* LD L,A */
+	regs->l = regs->a;
+	NEXT;
+OP(0x70)
+	/* LD (HL),B */
+	write_mem(state, regs, regs->hl, regs->b);
+	cycles = 8;
+	NEXT;
+OP(0x71)
+	/* LD (HL),C */
+	write_mem(state, regs, regs->hl, regs->c);
+	cycles = 8;
+	NEXT;
+OP(0x72)
+	/* LD (HL),D */
+	write_mem(state, regs, regs->hl, regs->d);
+	cycles = 8;
+	NEXT;
+OP(0x73)
+	/* LD (HL),E */
+	write_mem(state, regs, regs->hl, regs->e);
+	cycles = 8;
+	NEXT;
+OP(0x74)
+	/* LD (HL),H */
+	write_mem(state, regs, regs->hl, regs->h);
+	cycles = 8;
+	NEXT;
+OP(0x75)
+	/* LD (HL),L */
+	write_mem(state, regs, regs->hl, regs->l);
+	cycles = 8;
+	NEXT;
+OP(0x76)
+	/* HALT */
+	state->halt = 1;
+	update_interrupts();
+	if (!state->ime)
+		pc++;
+	NEXT;
+OP(0x77)
+	/* LD (HL),A */
+	write_mem(state, regs, regs->hl, regs->a);
+	cycles = 8;
+	NEXT;
+OP(0x78)
+	/* LD A,B */
+	regs->a = regs->b;
+	NEXT;
+OP(0x79)
+	/* LD A,C */
+	regs->a = regs->c;
+	NEXT;
+OP(0x7A)
+	/* LD A,D */
+	regs->a = regs->d;
+	NEXT;
+OP(0x7B)
+	/* LD A,E */
+	regs->a = regs->e;
+	NEXT;
+OP(0x7C)
+	/* LD A,H */
+	regs->a = regs->h;
+	NEXT;
+OP(0x7D)
+	/* LD A,L */
+	regs->a = regs->l;
+	NEXT;
+OP(0x7E)
+	/* LD A,(HL) */
+	regs->a = get_mem(regs->hl);
+	cycles = 8;
+	NEXT;
+OP(0x7F)
+	/* LD A,A */
+	regs->a = regs->a;
+	NEXT;
+OP(0x80)
+	/* ADD A,B */
+	addA(regs, regs->b);
+	NEXT;
+OP(0x81)
+	/* ADD A,C */
+	addA(regs, regs->c);
+	NEXT;
+OP(0x82)
+	/* ADD A,D */
+	addA(regs, regs->d);
+	NEXT;
+OP(0x83)
+	/* ADD A,E */
+	addA(regs, regs->e);
+	NEXT;
+OP(0x84)
+	/* ADD A,H */
+	addA(regs, regs->h);
+	NEXT;
+OP(0x85)
+	/* ADD A,L */
+	addA(regs, regs->l);
+	NEXT;
+OP(0x86)
+	/* ADD A,(HL) */
+	addA(regs, get_mem(regs->hl));
+	cycles = 8;
+	NEXT;
+OP(0x87)
+	/* ADD A,A */
+	addA(regs, regs->a);
+	NEXT;
+OP(0x88)
+	/* ADC A,B */
+	adc(regs, regs->b);
+	NEXT;
+OP(0x89)
+	/* ADC A,C */
+	adc(regs, regs->c);
+	NEXT;
+OP(0x8A)
+	/* ADC A,D */
+	adc(regs, regs->d);
+	NEXT;
+OP(0x8B)
+	/* ADC A,E */
+	adc(regs, regs->e);
+	NEXT;
+OP(0x8C)
+	/* ADC A,H */
+	adc(regs, regs->h);
+	NEXT;
+OP(0x8D)
+	/* ADC A,L */
+	adc(regs, regs->l);
+	NEXT;
+OP(0x8E)
+	/* ADC A,(HL) */
+	adc(regs, get_mem(regs->hl));
+	cycles = 8;
+	NEXT;
+OP(0x8F)
+	/* ADC A,A */
+	adc(regs, regs->a);
+	NEXT;
+OP(0x90)
+	/* SUB A,B */
+	subA(regs, regs->b);
+	NEXT;
+OP(0x91)
+	/* SUB A,C */
+	subA(regs, regs->c);
+	NEXT;
+OP(0x92)
+	/* SUB A,D */
+	subA(regs, regs->d);
+	NEXT;
+OP(0x93)
+	/* SUB A,E */
+	subA(regs, regs->e);
+	NEXT;
+OP(0x94)
+	/* SUB A,H */
+	subA(regs, regs->h);
+	NEXT;
+OP(0x95)
+	/* SUB A,L */
+	subA(regs, regs->l);
+	NEXT;
+OP(0x96)
+	/* SUB A,(HL) */
+	subA(regs, get_mem(regs->hl));
+	cycles = 8;
+	NEXT;
+OP(0x97)
+	/* SUB A,A */
+	subA(regs, regs->a);
+	NEXT;
+OP(0x98)
+	/* SBC A,B */
+	subc(regs, regs->b);
+	NEXT;
+OP(0x99)
+	/* SBC A,C */
+	subc(regs, regs->c);
+	NEXT;
+OP(0x9A)
+	/* SBC A,D */
+	subc(regs, regs->d);
+	NEXT;
+OP(0x9B)
+	/* SBC A,E */
+	subc(regs, regs->e);
+	NEXT;
+OP(0x9C)
+	/* SBC A,H */
+	subc(regs, regs->h);
+	NEXT;
+OP(0x9D)
+	/* SBC A,L */
+	subc(regs, regs->l);
+	NEXT;
+OP(0x9E)
+	/* SBC A,(HL) */
+	subc(regs, get_mem(regs->hl));
+	cycles = 8;
+	NEXT;
+OP(0x9F)
+	/* SBC A,A */
+	subc(regs, regs->a);
+	NEXT;
+OP(0xA0)
+	/* AND A,B */
+	andA(regs, regs->b);
+	NEXT;
+OP(0xA1)
+	/* AND A,C */
+	andA(regs, regs->c);
+	NEXT;
+OP(0xA2)
+	/* AND A,D */
+	andA(regs, regs->d);
+	NEXT;
+OP(0xA3)
+	/* AND A,E */
+	andA(regs, regs->e);
+	NEXT;
+OP(0xA4)
+	/* AND A,H */
+	andA(regs, regs->h);
+	NEXT;
+OP(0xA5)
+	/* AND A,L */
+	andA(regs, regs->l);
+	NEXT;
+OP(0xA6)
+	/* AND A,(HL) */
+	andA(regs, get_mem(regs->hl));
+	cycles = 8;
+	NEXT;
+OP(0xA7)
+	/* AND A,A */
+	andA(regs, regs->a);
+	NEXT;
+OP(0xA8)
+	/* XOR A,B */
+	xorA(regs, regs->b);
+	NEXT;
+OP(0xA9)
+	/* XOR A,C */
+	xorA(regs, regs->c);
+	NEXT;
+OP(0xAA)
+	/* XOR A,D */
+	xorA(regs, regs->d);
+	NEXT;
+OP(0xAB)
+	/* XOR A,E */
+	xorA(regs, regs->e);
+	NEXT;
+OP(0xAC)
+	/* XOR A,H */
+	xorA(regs, regs->h);
+	NEXT;
+OP(0xAD)
+	/* XOR A,L */
+	xorA(regs, regs->l);
+	NEXT;
+OP(0xAE)
+	/* XOR A,(HL) */
+	xorA(regs, get_mem(regs->hl));
+	cycles = 8;
+	NEXT;
+OP(0xAF)
+	/* XOR A */
+	xorA(regs, regs->a);
+	NEXT;
+OP(0xB0)
+	/* OR A,B */
+	orA(regs, regs->b);
+	NEXT;
+OP(0xB1)
+	/* OR A,C */
+	orA(regs, regs->c);
+	NEXT;
+OP(0xB2)
+	/* OR A,D */
+	orA(regs, regs->d);
+	NEXT;
+OP(0xB3)
+	/* OR A,E */
+	orA(regs, regs->e);
+	NEXT;
+OP(0xB4)
+	/* OR A,H */
+	orA(regs, regs->h);
+	NEXT;
+OP(0xB5)
+	/* OR A,L */
+	orA(regs, regs->l);
+	NEXT;
+OP(0xB6)
+	/* OR A,(HL) */
+	orA(regs, get_mem(regs->hl));
+	cycles = 8;
+	NEXT;
+OP(0xB7)
+	/* OR A,A */
+	orA(regs, regs->a);
+	NEXT;
+OP(0xB8)
+	/* CP A,B */
+	cpA(regs, regs->b);
+	NEXT;
+OP(0xB9)
+	/* CP A,C */
+	cpA(regs, regs->c);
+	NEXT;
+OP(0xBA)
+	/* CP A,D */
+	cpA(regs, regs->d);
+	NEXT;
+OP(0xBB)
+	/* CP A,E */
+	cpA(regs, regs->e);
+	NEXT;
+OP(0xBC)
+	/* CP A,H */
+	cpA(regs, regs->h);
+	NEXT;
+OP(0xBD)
+	/* CP A,L */
+	cpA(regs, regs->l);
+	NEXT;
+OP(0xBE)
+	/* CP A,(HL) */
+	cpA(regs, get_mem(regs->hl));
+	cycles = 8;
+	NEXT;
+OP(0xBF)
+	/* CP A */
+	cpA(regs, regs->a);
+	NEXT;
+OP(0xC0)
+	/* RET NZ */
+	cycles = !flag_z(regs) ? 20 : 8;
+	ret(regs, !flag_z(regs));
+	NEXT;
+OP(0xC1)
+	/* POP BC */
+	pop(regs, &regs->bc);
+	cycles = 12;
+	NEXT;
+OP(0xC2)
+	/* JP NZ,nn */
+	regs->pc += 2;
+	jump(regs, !flag_z(regs), nn);
+	cycles = !flag_z(regs) ? 16 : 12;
+	NEXT;
+OP(0xC3)
+	/* JP nn */
+	regs->pc += 2;
+	jump(regs, 1, nn);
+	cycles = 16;
+	NEXT;
+OP(0xC4)
+	/* CALL NZ,nn */
+	regs->pc += 2;
+	call(state, regs, !flag_z(regs), nn);
+	cycles = !flag_z(regs) ? 24 : 12;
+	NEXT;
+OP(0xC5)
+	/* PUSH BC */
+	cycles = 16;
+	push(state, regs, regs->bc);
+	NEXT;
+OP(0xC6)
+	/* ADD A,n */
+	cycles = 8;
+	regs->pc++;
+	addA(regs, op[1]);
+	NEXT;
+OP(0xC7)
+	/* RST 0x00 */
+	cycles = 16;
+	rst(state, regs, 0x00);
+	NEXT;
+OP(0xC8)
+	/* RET Z */
+	ret(regs, flag_z(regs));
+	cycles = flag_z(regs) ? 20 : 8;
+	NEXT;
+OP(0xC9)
+	/* RET */
+	ret(regs, 1);
+	cycles = 16;
+	NEXT;
+OP(0xCA)
+	/* JP Z,nn */
+	regs->pc += 2;
+	jump(regs, flag_z(regs), nn);
+	cycles = flag_z(regs) ? 16 : 12;
+	NEXT;
+OP(0xCB)
+	CB_PREFIX;
+	NEXT;
+OP(0xCC)
+	/* CALL Z,nn */
+	regs->pc += 2;
+	call(state, regs, flag_z(regs), nn);
+	cycles = flag_z(regs) ? 24 : 12;
+	NEXT;
+OP(0xCD)
+	/* CALL nn */
+	regs->pc += 2;
+	call(state, regs, 1, nn);
+	cycles = 24;
+	NEXT;
+OP(0xCE)
+	/* ADC A,n */
+	regs->pc++;
+	adc(regs, op[1]);
+	cycles = 8;
+	NEXT;
+OP(0xCF)
+	/* RST 0x08 */
+	cycles = 16;
+	rst(state, regs, 0x08);
+	NEXT;
+OP(0xD0)
+	/* RET NC */
+	ret(regs, !flag_c(regs));
+	cycles = !flag_c(regs) ? 20 : 8;
+	NEXT;
+OP(0xD1)
+	/* POP DE */
+	pop(regs, &regs->de);
+	cycles = 12;
+	NEXT;
+OP(0xD2)
+	/* JP NC,nn */
+	regs->pc += 2;
+	jump(regs, !flag_c(regs), nn);
+	cycles = !flag_c(regs) ? 16 : 12;
+	NEXT;
+OP(0xD4)
+	/* CALL NC,nn */
+	regs->pc += 2;
+	call(state, regs, !flag_c(regs), nn);
+	cycles = !flag_c(regs) ? 24 : 12;
+	NEXT;
+OP(0xD5)
+	/* PUSH DE */
+	cycles = 16;
+	push(state, regs, regs->de);
+	NEXT;
+OP(0xD6)
+	/* SUB A,n */
+	cycles = 8;
+	regs->pc++;
+	subA(regs, op[1]);
+	NEXT;
+OP(0xD7)
+	/* RST 0x10 */
+	cycles = 16;
+	rst(state, regs, 0x10);
+	NEXT;
+OP(0xD8)
+	/* RET C */
+	ret(regs, flag_c(regs));
+	cycles = flag_c(regs) ? 20 : 8;
+	NEXT;
+OP(0xD9)
+	/* RETI */
+	ret(regs, 1);
+	state->ime = 1;
+	update_interrupts();
+	cycles = 16;
+	NEXT;
+OP(0xDA)
+	/* JP C,nn */
+	regs->pc += 2;
+	jump(regs, flag_c(regs), nn);
+	cycles = flag_c(regs) ? 16 : 12;
+	NEXT;
+OP(0xDC)
+	/* CALL C,nn */
+	regs->pc += 2;
+	call(state, regs, flag_c(regs), nn);
+	cycles = flag_c(regs) ? 24 : 12;
+	NEXT;
+OP(0xDE)
+	/* SDC A,n */
+	regs->pc++;
+	subc(regs, op[1]);
+	cycles = 8;
+	NEXT;
+OP(0xDF)
+	/* RST 0x18 */
+	cycles = 16;
+	rst(state, regs, 0x18);
+	NEXT;
+OP(0xE0)
+	/* 
+	 * LDH (n),A
+	 * LD (n+$FF00),A
+	 */
+	write_mem(state, regs, op[1] + IO_PORTS, regs->a);
+	cycles = 12;
+	regs->pc++;
+	NEXT;
+OP(0xE1)
+	/* POP HL */
+	pop(regs, &regs->hl);
+	cycles = 12;
+	NEXT;
+OP(0xE2)
+	/* LD (C+$FF00),A */
+	write_mem(state, regs, regs->c + IO_PORTS, regs->a);
+	cycles = 8;
+	NEXT;
+OP(0xE5)
+	/* PUSH HL */
+	cycles = 16;
+	push(state, regs, regs->hl);
+	NEXT;
+OP(0xE6)
+	/* AND A,n */
+	cycles = 8;
+	regs->pc++;
+	andA(regs, op[1]);
+	NEXT;
+OP(0xE7)
+	/* RST 0x20 */
+	cycles = 16;
+	rst(state, regs, 0x20);
+	NEXT;
+OP(0xE8)
+	/* ADD SP,n */
+	cycles = 16;
+	set_add8_flags(regs, regs->sp & 0xFF, op[1],1);
+	sync_flags(regs);
+	regs->fz = 0;
+	regs->fn = 0;
+	regs->sp += (int8_t)op[1];
+	regs->pc++;
+	NEXT;
+OP(0xE9)
+	/* JP (HL) */
+	regs->pc = regs->hl;
+	NEXT;
+OP(0xEA)
+	/* LD (nn),A */
+	write_mem(state, regs, nn, regs->a);
+	regs->pc += 2;
+	cycles = 16;
+	NEXT;
+OP(0xEE)
+	/* XOR A,n */
+	regs->pc++;
+	xorA(regs, op[1]);
+	cycles = 8;
+	NEXT;
+OP(0xEF)
+	/* RST 0x28 */
+	cycles = 16;
+	rst(state, regs, 0x28);
+	NEXT;
+OP(0xF0)
+	/* 
+	 * LDH A,(n)
+	 * LD A,(n+$FF00)
+	 */
+	regs->a = get_io(op[1]);
+	cycles = 12;
+	regs->pc++;
+	NEXT;
+OP(0xF1)
+	/* POP AF */
+	sync_flags(regs);
+	pop(regs, &regs->af);
+	regs->fl = 0;
+	cycles = 12;
+	NEXT;
+OP(0xF2)
+	/* LD A,(C+$FF00) */
+	regs->a = get_io(regs->c);
+	cycles = 8;
+	NEXT;
+OP(0xF3)
+	/* DI */
+	state->di_flag = 1;
+	NEXT;
+OP(0xF5)
+	/* PUSH AF */
+	cycles = 16;
+	sync_flags(regs);
+	regs->fl = 0;
+	push(state, regs, regs->af);
+	NEXT;
+OP(0xF6)
+	/* OR A,n */
+	cycles = 8;
+	regs->pc++;
+	orA(regs, op[1]);
+	NEXT;
+OP(0xF7)
+	/* RST 0x30 */
+	cycles = 16;
+	rst(state, regs, 0x30);
+	NEXT;
+OP(0xF8)
+	/* LD HL,SP+n */
+	/* LDHL SP,n */
+	regs->pc++;
+	set_add8_flags(regs, regs->sp & 0xFF, op[1],1);
+	sync_flags(regs);
+	regs->fz = 0;
+	regs->fn = 0;
+	regs->hl = regs->sp + (int8_t)op[1];
+	cycles = 12;
+	NEXT;
+OP(0xF9)
+	/* LD SP,HL */
+	regs->sp = regs->hl;
+	cycles = 8;
+	NEXT;
+OP(0xFA)
+	/* LD A,(nn) */
+	regs->pc += 2;
+	regs->a = get_mem(nn);
+	cycles = 16;
+	NEXT;
+OP(0xFB)
+	/* EI */
+	state->ei_flag = 1;
+	NEXT;
+OP(0xFE)
+	/* CP A,n */
+	regs->pc++;
+	cpA(regs, op[1]);
+	cycles = 8;
+	NEXT;
+OP(0xFF)
+	/* RST 0x38 */
+	cycles = 16;
+	rst(state, regs, 0x38);
+	NEXT;
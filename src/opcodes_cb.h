@@ -0,0 +1,1118 @@
+/*
+ * 0xCB prefixed opcode handlers shared by the CPU cores in cpu.c.
+ * Included once per core like opcodes.h. Handlers may use state,
+ * regs, tmp and cycles.
+ */
+
+OP(0x00)
+	/* RLC B */
+	rot_left_carry(regs, &regs->b);
+	NEXT;
+OP(0x01)
+	/* RLC C */
+	rot_left_carry(regs, &regs->c);
+	NEXT;
+OP(0x02)
+	/* RLC D */
+	rot_left_carry(regs, &regs->d);
+	NEXT;
+OP(0x03)
+	/* RLC E */
+	rot_left_carry(regs, &regs->e);
+	NEXT;
+OP(0x04)
+	/* RLC H */
+	rot_left_carry(regs, &regs->h);
+	NEXT;
+OP(0x05)
+	/* RLC L */
+	rot_left_carry(regs, &regs->l);
+	NEXT;
+OP(0x06)
+	/* RLC (HL) */
+	tmp = get_mem(regs->hl);
+	rot_left_carry(regs, &tmp);
+	write_mem(state, regs, regs->hl, tmp);
+	cycles = 16;
+	NEXT;
+OP(0x07)
+	/* RLC A */
+	rot_left_carry(regs, &regs->a);
+	NEXT;
+OP(0x08)
+	/* RRC B */
+	rot_right_carry(regs, &regs->b);
+	NEXT;
+OP(0x09)
+	/* RRC C */
+	rot_right_carry(regs, &regs->c);
+	NEXT;
+OP(0x0A)
+	/* RRC D */
+	rot_right_carry(regs, &regs->d);
+	NEXT;
+OP(0x0B)
+	/* RRC E */
+	rot_right_carry(regs, &regs->e);
+	NEXT;
+OP(0x0C)
+	/* RRC H */
+	rot_right_carry(regs, &regs->h);
+	NEXT;
+OP(0x0D)
+	/* RRC L */
+	rot_right_carry(regs, &regs->l);
+	NEXT;
+OP(0x0E)
+	/* RRC (HL) */
+	tmp = get_mem(regs->hl);
+	rot_right_carry(regs, &tmp);
+	write_mem(state, regs, regs->hl, tmp);
+	cycles = 16;
+	NEXT;
+OP(0x0F)
+	/* RRC A */
+	rot_right_carry(regs, &regs->a);
+	NEXT;
+OP(0x10)
+	/* RL B */
+	rot_left(regs, &regs->b);
+	NEXT;
+OP(0x11)
+	/* RL C */
+	rot_left(regs, &regs->c);
+	NEXT;
+OP(0x12)
+	/* RL D */
+	rot_left(regs, &regs->d);
+	NEXT;
+OP(0x13)
+	/* RL E */
+	rot_left(regs, &regs->e);
+	NEXT;
+OP(0x14)
+	/* RL H */
+	rot_left(regs, &regs->h);
+	NEXT;
+OP(0x15)
+	/* RL L */
+	rot_left(regs, &regs->l);
+	NEXT;
+OP(0x16)
+	/* RL (HL) */
+	tmp = get_mem(regs->hl);
+	rot_left(regs, &tmp);
+	write_mem(state, regs, regs->hl, tmp);
+	cycles = 16;
+	NEXT;
+OP(0x17)
+	/* RL A */
+	rot_left(regs, &regs->a);
+	NEXT;
+OP(0x18)
+	/* RR B */
+	rot_right(regs, &regs->b);
+	NEXT;
+OP(0x19)
+	/* RR C */
+	rot_right(regs, &regs->c);
+	NEXT;
+OP(0x1A)
+	/* RR D */
+	rot_right(regs, &regs->d);
+	NEXT;
+OP(0x1B)
+	/* RR E */
+	rot_right(regs, &regs->e);
+	NEXT;
+OP(0x1C)
+	/* RR H */
+	rot_right(regs, &regs->h);
+	NEXT;
+OP(0x1D)
+	/* RR L */
+	rot_right(regs, &regs->l);
+	NEXT;
+OP(0x1E)
+	/* RR (HL) */
+	tmp = get_mem(regs->hl);
+	rot_right(regs, &tmp);
+	write_mem(state, regs, regs->hl, tmp);
+	cycles = 16;
+	NEXT;
+OP(0x1F)
+	/* RR A */
+	rot_right(regs, &regs->a);
+	NEXT;
+OP(0x20)
+	/* SLA B */
+	sla(regs, &regs->b);
+	NEXT;
+OP(0x21)
+	/* SLA C */
+	sla(regs, &regs->c);
+	NEXT;
+OP(0x22)
+	/* SLA D */
+	sla(regs, &regs->d);
+	NEXT;
+OP(0x23)
+	/* SLA E */
+	sla(regs, &regs->e);
+	NEXT;
+OP(0x24)
+	/* SLA H */
+	sla(regs, &regs->h);
+	NEXT;
+OP(0x25)
+	/* SLA L */
+	sla(regs, &regs->l);
+	NEXT;
+OP(0x26)
+	/* SLA (HL) */
+	tmp = get_mem(regs->hl);
+	sla(regs, &tmp);
+	write_mem(state, regs, regs->hl, tmp);
+	cycles = 16;
+	NEXT;
+OP(0x27)
+	/* SLA A */
+	sla(regs, &regs->a);
+	NEXT;
+OP(0x28)
+	/* SRA B */
+	sra(regs, &regs->b);
+	NEXT;
+OP(0x29)
+	/* SRA C */
+	sra(regs, &regs->c);
+	NEXT;
+OP(0x2A)
+	/* SRA D */
+	sra(regs, &regs->d);
+	NEXT;
+OP(0x2B)
+	/* SRA E */
+	sra(regs, &regs->e);
+	NEXT;
+OP(0x2C)
+	/* SRA H */
+	sra(regs, &regs->h);
+	NEXT;
+OP(0x2D)
+	/* SRA L */
+	sra(regs, &regs->l);
+	NEXT;
+OP(0x2E)
+	/* SRA (HL) */
+	tmp = get_mem(regs->hl);
+	sra(regs, &tmp);
+	write_mem(state, regs, regs->hl, tmp);
+	cycles = 16;
+	NEXT;
+OP(0x2F)
+	/* SRA A */
+	sra(regs, &regs->a);
+	NEXT;
+OP(0x30)
+	/* SWAP B */
+	swap(regs, &regs->b);
+	NEXT;
+OP(0x31)
+	/* SWAP C */
+	swap(regs, &regs->c);
+	NEXT;
+OP(0x32)
+	/* SWAP D */
+	swap(regs, &regs->d);
+	NEXT;
+OP(0x33)
+	/* SWAP E */
+	swap(regs, &regs->e);
+	NEXT;
+OP(0x34)
+	/* SWAP H */
+	swap(regs, &regs->h);
+	NEXT;
+OP(0x35)
+	/* SWAP L */
+	swap(regs, &regs->l);
+	NEXT;
+OP(0x36)
+	/* SWAP (HL) */
+	tmp = get_mem(regs->hl);
+	swap(regs, &tmp);
+	write_mem(state, regs, regs->hl, tmp);
+	cycles = 16;
+	NEXT;
+OP(0x37)
+	/* SWAP A */
+	swap(regs, &regs->a);
+	NEXT;
+OP(0x38)
+	/* SRL B */
+	srl(regs, &regs->b);
+	NEXT;
+OP(0x39)
+	/* SRL C */
+	srl(regs, &regs->c);
+	NEXT;
+OP(0x3A)
+	/* SRL D */
+	srl(regs, &regs->d);
+	NEXT;
+OP(0x3B)
+	/* SRL E */
+	srl(regs, &regs->e);
+	NEXT;
+OP(0x3C)
+	/* SRL H */
+	srl(regs, &regs->h);
+	NEXT;
+OP(0x3D)
+	/* SRL L */
+	srl(regs, &regs->l);
+	NEXT;
+OP(0x3E)
+	/* SRL (HL) */
+	tmp = get_mem(regs->hl);
+	srl(regs, &tmp);
+	write_mem(state, regs, regs->hl, tmp);
+	cycles = 16;
+	NEXT;
+OP(0x3F)
+	/* SRL A */
+	srl(regs, &regs->a);
+	NEXT;
+OP(0x40)
+	/* BIT 0,B */
+	bit(regs, 0, &regs->b);
+	NEXT;
+OP(0x41)
+	/* BIT 0,C */
+	bit(regs, 0, &regs->c);
+	NEXT;
+OP(0x42)
+	/* BIT 0,D */
+	bit(regs, 0, &regs->d);
+	NEXT;
+OP(0x43)
+	/* BIT 0,E */
+	bit(regs, 0, &regs->e);
+	NEXT;
+OP(0x44)
+	/* BIT 0,H */
+	bit(regs, 0, &regs->h);
+	NEXT;
+OP(0x45)
+	/* BIT 0,L */
+	bit(regs, 0, &regs->l);
+	NEXT;
+OP(0x46)
+	/* BIT 0,(HL) */
+	tmp = get_mem(regs->hl);
+	bit(regs, 0, &tmp);
+	cycles = 12;
+	NEXT;
+OP(0x47)
+	/* BIT 0,A */
+	bit(regs, 0, &regs->a);
+	NEXT;
+OP(0x48)
+	/* BIT 1,B */
+	bit(regs, 1, &regs->b);
+	NEXT;
+OP(0x49)
+	/* BIT 1,C */
+	bit(regs, 1, &regs->c);
+	NEXT;
+OP(0x4A)
+	/* BIT 1,D */
+	bit(regs, 1, &regs->d);
+	NEXT;
+OP(0x4B)
+	/* BIT 1,E */
+	bit(regs, 1, &regs->e);
+	NEXT;
+OP(0x4C)
+	/* BIT 1,H */
+	bit(regs, 1, &regs->h);
+	NEXT;
+OP(0x4D)
+	/* BIT 1,L */
+	bit(regs, 1, &regs->l);
+	NEXT;
+OP(0x4E)
+	/* BIT 1,(HL) */
+	tmp = get_mem(regs->hl);
+	bit(regs, 1, &tmp);
+	cycles = 12;
+	NEXT;
+OP(0x4F)
+	/* BIT 1,A */
+	bit(regs, 1, &regs->a);
+	NEXT;
+OP(0x50)
+	/* BIT 2,B */
+	bit(regs, 2, &regs->b);
+	NEXT;
+OP(0x51)
+	/* BIT 2,C */
+	bit(regs, 2, &regs->c);
+	NEXT;
+OP(0x52)
+	/* BIT 2,D */
+	bit(regs, 2, &regs->d);
+	NEXT;
+OP(0x53)
+	/* BIT 2,E */
+	bit(regs, 2, &regs->e);
+	NEXT;
+OP(0x54)
+	/* BIT 2,H */
+	bit(regs, 2, &regs->h);
+	NEXT;
+OP(0x55)
+	/* BIT 2,L */
+	bit(regs, 2, &regs->l);
+	NEXT;
+OP(0x56)
+	/* BIT 2,(HL) */
+	tmp = get_mem(regs->hl);
+	bit(regs, 2, &tmp);
+	cycles = 12;
+	NEXT;
+OP(0x57)
+	/* BIT 2,A */
+	bit(regs, 2, &regs->a);
+	NEXT;
+OP(0x58)
+	/* BIT 3,B */
+	bit(regs, 3, &regs->b);
+	NEXT;
+OP(0x59)
+	/* BIT 3,C */
+	bit(regs, 3, &regs->c);
+	NEXT;
+OP(0x5A)
+	/* BIT 3,D */
+	bit(regs, 3, &regs->d);
+	NEXT;
+OP(0x5B)
+	/* BIT 3,E */
+	bit(regs, 3, &regs->e);
+	NEXT;
+OP(0x5C)
+	/* BIT 3,H */
+	bit(regs, 3, &regs->h);
+	NEXT;
+OP(0x5D)
+	/* BIT 3,L */
+	bit(regs, 3, &regs->l);
+	NEXT;
+OP(0x5E)
+	/* BIT 3,(HL) */
+	tmp = get_mem(regs->hl);
+	bit(regs, 3, &tmp);
+	cycles = 12;
+	NEXT;
+OP(0x5F)
+	/* BIT 3,A */
+	bit(regs, 3, &regs->a);
+	NEXT;
+OP(0x60)
+	/* BIT 4,B */
+	bit(regs, 4, &regs->b);
+	NEXT;
+OP(0x61)
+	/* BIT 4,C */
+	bit(regs, 4, &regs->c);
+	NEXT;
+OP(0x62)
+	/* BIT 4,D */
+	bit(regs, 4, &regs->d);
+	NEXT;
+OP(0x63)
+	/* BIT 4,E */
+	bit(regs, 4, &regs->e);
+	NEXT;
+OP(0x64)
+	/* BIT 4,H */
+	bit(regs, 4, &regs->h);
+	NEXT;
+OP(0x65)
+	/* BIT 4,L */
+	bit(regs, 4, &regs->l);
+	NEXT;
+OP(0x66)
+	/* BIT 4,(HL) */
+	tmp = get_mem(regs->hl);
+	bit(regs, 4, &tmp);
+	cycles = 12;
+	NEXT;
+OP(0x67)
+	/* BIT 4,A */
+	bit(regs, 4, &regs->a);
+	NEXT;
+OP(0x68)
+	/* BIT 5,B */
+	bit(regs, 5, &regs->b);
+	NEXT;
+OP(0x69)
+	/* BIT 5,C */
+	bit(regs, 5, &regs->c);
+	NEXT;
+OP(0x6A)
+	/* BIT 5,D */
+	bit(regs, 5, &regs->d);
+	NEXT;
+OP(0x6B)
+	/* BIT 5,E */
+	bit(regs, 5, &regs->e);
+	NEXT;
+OP(0x6C)
+	/* BIT 5,H */
+	bit(regs, 5, &regs->h);
+	NEXT;
+OP(0x6D)
+	/* BIT 5,L */
+	bit(regs, 5, &regs->l);
+	NEXT;
+OP(0x6E)
+	/* BIT 5,(HL) */
+	tmp = get_mem(regs->hl);
+	bit(regs, 5, &tmp);
+	cycles = 12;
+	NEXT;
+OP(0x6F)
+	/* BIT 5,A */
+	bit(regs, 5, &regs->a);
+	NEXT;
+OP(0x70)
+	/* BIT 6,B */
+	bit(regs, 6, &regs->b);
+	NEXT;
+OP(0x71)
+	/* BIT 6,C */
+	bit(regs, 6, &regs->c);
+	NEXT;
+OP(0x72)
+	/* BIT 6,D */
+	bit(regs, 6, &regs->d);
+	NEXT;
+OP(0x73)
+	/* BIT 6,E */
+	bit(regs, 6, &regs->e);
+	NEXT;
+OP(0x74)
+	/* BIT 6,H */
+	bit(regs, 6, &regs->h);
+	NEXT;
+OP(0x75)
+	/* BIT 6,L */
+	bit(regs, 6, &regs->l);
+	NEXT;
+OP(0x76)
+	/* BIT 6,(HL) */
+	tmp = get_mem(regs->hl);
+	bit(regs, 6, &tmp);
+	cycles = 12;
+	NEXT;
+OP(0x77)
+	/* BIT 6,A */
+	bit(regs, 6, &regs->a);
+	NEXT;
+OP(0x78)
+	/* BIT 7,B */
+	bit(regs, 7, &regs->b);
+	NEXT;
+OP(0x79)
+	/* BIT 7,C */
+	bit(regs, 7, &regs->c);
+	NEXT;
+OP(0x7A)
+	/* BIT 7,D */
+	bit(regs, 7, &regs->d);
+	NEXT;
+OP(0x7B)
+	/* BIT 7,E */
+	bit(regs, 7, &regs->e);
+	NEXT;
+OP(0x7C)
+	/* BIT 7,H */
+	bit(regs, 7, &regs->h);
+	NEXT;
+OP(0x7D)
+	/* BIT 7,L */
+	bit(regs, 7, &regs->l);
+	NEXT;
+OP(0x7E)
+	/* BIT 7,(HL) */
+	tmp = get_mem(regs->hl);
+	bit(regs, 7, &tmp);
+	cycles = 12;
+	NEXT;
+OP(0x7F)
+	/* BIT 7,A */
+	bit(regs, 7, &regs->a);
+	NEXT;
+OP(0x80)
+	/* RES 0,B */
+	res(regs, 0, &regs->b);
+	NEXT;
+OP(0x81)
+	/* RES 0,C */
+	res(regs, 0, &regs->c);
+	NEXT;
+OP(0x82)
+	/* RES 0,D */
+	res(regs, 0, &regs->d);
+	NEXT;
+OP(0x83)
+	/* RES 0,E */
+	res(regs, 0, &regs->e);
+	NEXT;
+OP(0x84)
+	/* RES 0,H */
+	res(regs, 0, &regs->h);
+	NEXT;
+OP(0x85)
+	/* RES 0,L */
+	res(regs, 0, &regs->l);
+	NEXT;
+OP(0x86)
+	/* RES 0,(HL) */
+	tmp = get_mem(regs->hl);
+	res(regs, 0, &tmp);
+	write_mem(state, regs, regs->hl, tmp);
+	cycles = 16;
+	NEXT;
+OP(0x87)
+	/* RES 0,A */
+	res(regs, 0, &regs->a);
+	NEXT;
+OP(0x88)
+	/* RES 1,B */
+	res(regs, 1, &regs->b);
+	NEXT;
+OP(0x89)
+	/* RES 1,C */
+	res(regs, 1, &regs->c);
+	NEXT;
+OP(0x8A)
+	/* RES 1,D */
+	res(regs, 1, &regs->d);
+	NEXT;
+OP(0x8B)
+	/* RES 1,E */
+	res(regs, 1, &regs->e);
+	NEXT;
+OP(0x8C)
+	/* RES 1,H */
+	res(regs, 1, &regs->h);
+	NEXT;
+OP(0x8D)
+	/* RES 1,L */
+	res(regs, 1, &regs->l);
+	NEXT;
+OP(0x8E)
+	/* RES 1,(HL) */
+	tmp = get_mem(regs->hl);
+	res(regs, 1, &tmp);
+	write_mem(state, regs, regs->hl, tmp);
+	cycles = 16;
+	NEXT;
+OP(0x8F)
+	/* RES 1,A */
+	res(regs, 1, &regs->a);
+	NEXT;
+OP(0x90)
+	/* RES 2,B */
+	res(regs, 2, &regs->b);
+	NEXT;
+OP(0x91)
+	/* RES 2,C */
+	res(regs, 2, &regs->c);
+	NEXT;
+OP(0x92)
+	/* RES 2,D */
+	res(regs, 2, &regs->d);
+	NEXT;
+OP(0x93)
+	/* RES 2,E */
+	res(regs, 2, &regs->e);
+	NEXT;
+OP(0x94)
+	/* RES 2,H */
+	res(regs, 2, &regs->h);
+	NEXT;
+OP(0x95)
+	/* RES 2,L */
+	res(regs, 2, &regs->l);
+	NEXT;
+OP(0x96)
+	/* RES 2,(HL) */
+	tmp = get_mem(regs->hl);
+	res(regs, 2, &tmp);
+	write_mem(state, regs, regs->hl, tmp);
+	cycles = 16;
+	NEXT;
+OP(0x97)
+	/* RES 2,A */
+	res(regs, 2, &regs->a);
+	NEXT;
+OP(0x98)
+	/* RES 3,B */
+	res(regs, 3, &regs->b);
+	NEXT;
+OP(0x99)
+	/* RES 3,C */
+	res(regs, 3, &regs->c);
+	NEXT;
+OP(0x9A)
+	/* RES 3,D */
+	res(regs, 3, &regs->d);
+	NEXT;
+OP(0x9B)
+	/* RES 3,E */
+	res(regs, 3, &regs->e);
+	NEXT;
+OP(0x9C)
+	/* RES 3,H */
+	res(regs, 3, &regs->h);
+	NEXT;
+OP(0x9D)
+	/* RES 3,L */
+	res(regs, 3, &regs->l);
+	NEXT;
+OP(0x9E)
+	/* RES 3,(HL) */
+	tmp = get_mem(regs->hl);
+	res(regs, 3, &tmp);
+	write_mem(state, regs, regs->hl, tmp);
+	cycles = 16;
+	NEXT;
+OP(0x9F)
+	/* RES 3,A */
+	res(regs, 3, &regs->a);
+	NEXT;
+OP(0xA0)
+	/* RES 4,B */
+	res(regs, 4, &regs->b);
+	NEXT;
+OP(0xA1)
+	/* RES 4,C */
+	res(regs, 4, &regs->c);
+	NEXT;
+OP(0xA2)
+	/* RES 4,D */
+	res(regs, 4, &regs->d);
+	NEXT;
+OP(0xA3)
+	/* RES 4,E */
+	res(regs, 4, &regs->e);
+	NEXT;
+OP(0xA4)
+	/* RES 4,H */
+	res(regs, 4, &regs->h);
+	NEXT;
+OP(0xA5)
+	/* RES 4,L */
+	res(regs, 4, &regs->l);
+	NEXT;
+OP(0xA6)
+	/* RES 4,(HL) */
+	tmp = get_mem(regs->hl);
+	res(regs, 4, &tmp);
+	write_mem(state, regs, regs->hl, tmp);
+	cycles = 16;
+	NEXT;
+OP(0xA7)
+	/* RES 4,A */
+	res(regs, 4, &regs->a);
+	NEXT;
+OP(0xA8)
+	/* RES 5,B */
+	res(regs, 5, &regs->b);
+	NEXT;
+OP(0xA9)
+	/* RES 5,C */
+	res(regs, 5, &regs->c);
+	NEXT;
+OP(0xAA)
+	/* RES 5,D */
+	res(regs, 5, &regs->d);
+	NEXT;
+OP(0xAB)
+	/* RES 5,E */
+	res(regs, 5, &regs->e);
+	NEXT;
+OP(0xAC)
+	/* RES 5,H */
+	res(regs, 5, &regs->h);
+	NEXT;
+OP(0xAD)
+	/* RES 5,L */
+	res(regs, 5, &regs->l);
+	NEXT;
+OP(0xAE)
+	/* RES 5,(HL) */
+	tmp = get_mem(regs->hl);
+	res(regs, 5, &tmp);
+	write_mem(state, regs, regs->hl, tmp);
+	cycles = 16;
+	NEXT;
+OP(0xAF)
+	/* RES 5,A */
+	res(regs, 5, &regs->a);
+	NEXT;
+OP(0xB0)
+	/* RES 6,B */
+	res(regs, 6, &regs->b);
+	NEXT;
+OP(0xB1)
+	/* RES 6,C */
+	res(regs, 6, &regs->c);
+	NEXT;
+OP(0xB2)
+	/* RES 6,D */
+	res(regs, 6, &regs->d);
+	NEXT;
+OP(0xB3)
+	/* RES 6,E */
+	res(regs, 6, &regs->e);
+	NEXT;
+OP(0xB4)
+	/* RES 6,H */
+	res(regs, 6, &regs->h);
+	NEXT;
+OP(0xB5)
+	/* RES 6,L */
+	res(regs, 6, &regs->l);
+	NEXT;
+OP(0xB6)
+	/* RES 6,(HL) */
+	tmp = get_mem(regs->hl);
+	res(regs, 6, &tmp);
+	write_mem(state, regs, regs->hl, tmp);
+	cycles = 16;
+	NEXT;
+OP(0xB7)
+	/* RES 6,A */
+	res(regs, 6, &regs->a);
+	NEXT;
+OP(0xB8)
+	/* RES 7,B */
+	res(regs, 7, &regs->b);
+	NEXT;
+OP(0xB9)
+	/* RES 7,C */
+	res(regs, 7, &regs->c);
+	NEXT;
+OP(0xBA)
+	/* RES 7,D */
+	res(regs, 7, &regs->d);
+	NEXT;
+OP(0xBB)
+	/* RES 7,E */
+	res(regs, 7, &regs->e);
+	NEXT;
+OP(0xBC)
+	/* RES 7,H */
+	res(regs, 7, &regs->h);
+	NEXT;
+OP(0xBD)
+	/* RES 7,L */
+	res(regs, 7, &regs->l);
+	NEXT;
+OP(0xBE)
+	/* RES 7,(HL) */
+	tmp = get_mem(regs->hl);
+	res(regs, 7, &tmp);
+	write_mem(state, regs, regs->hl, tmp);
+	cycles = 16;
+	NEXT;
+OP(0xBF)
+	/* RES 7,A */
+	res(regs, 7, &regs->a);
+	NEXT;
+OP(0xC0)
+	/* SET 0,B */
+	set(regs, 0, &regs->b);
+	NEXT;
+OP(0xC1)
+	/* SET 0,C */
+	set(regs, 0, &regs->c);
+	NEXT;
+OP(0xC2)
+	/* SET 0,D */
+	set(regs, 0, &regs->d);
+	NEXT;
+OP(0xC3)
+	/* SET 0,E */
+	set(regs, 0, &regs->e);
+	NEXT;
+OP(0xC4)
+	/* SET 0,H */
+	set(regs, 0, &regs->h);
+	NEXT;
+OP(0xC5)
+	/* SET 0,L */
+	set(regs, 0, &regs->l);
+	NEXT;
+OP(0xC6)
+	/* SET 0,(HL) */
+	tmp = get_mem(regs->hl);
+	set(regs, 0, &tmp);
+	write_mem(state, regs, regs->hl, tmp);
+	cycles = 16;
+	NEXT;
+OP(0xC7)
+	/* SET 0,A */
+	set(regs, 0, &regs->a);
+	NEXT;
+OP(0xC8)
+	/* SET 1,B */
+	set(regs, 1, &regs->b);
+	NEXT;
+OP(0xC9)
+	/* SET 1,C */
+	set(regs, 1, &regs->c);
+	NEXT;
+OP(0xCA)
+	/* SET 1,D */
+	set(regs, 1, &regs->d);
+	NEXT;
+OP(0xCB)
+	/* SET 1,E */
+	set(regs, 1, &regs->e);
+	NEXT;
+OP(0xCC)
+	/* SET 1,H */
+	set(regs, 1, &regs->h);
+	NEXT;
+OP(0xCD)
+	/* SET 1,L */
+	set(regs, 1, &regs->l);
+	NEXT;
+OP(0xCE)
+	/* SET 1,(HL) */
+	tmp = get_mem(regs->hl);
+	set(regs, 1, &tmp);
+	write_mem(state, regs, regs->hl, tmp);
+	cycles = 16;
+	NEXT;
+OP(0xCF)
+	/* SET 1,A */
+	set(regs, 1, &regs->a);
+	NEXT;
+OP(0xD0)
+	/* SET 2,B */
+	set(regs, 2, &regs->b);
+	NEXT;
+OP(0xD1)
+	/* SET 2,C */
+	set(regs, 2, &regs->c);
+	NEXT;
+OP(0xD2)
+	/* SET 2,D */
+	set(regs, 2, &regs->d);
+	NEXT;
+OP(0xD3)
+	/* SET 2,E */
+	set(regs, 2, &regs->e);
+	NEXT;
+OP(0xD4)
+	/* SET 2,H */
+	set(regs, 2, &regs->h);
+	NEXT;
+OP(0xD5)
+	/* SET 2,L */
+	set(regs, 2, &regs->l);
+	NEXT;
+OP(0xD6)
+	/* SET 2,(HL) */
+	tmp = get_mem(regs->hl);
+	set(regs, 2, &tmp);
+	write_mem(state, regs, regs->hl, tmp);
+	cycles = 16;
+	NEXT;
+OP(0xD7)
+	/* SET 2,A */
+	set(regs, 2, &regs->a);
+	NEXT;
+OP(0xD8)
+	/* SET 3,B */
+	set(regs, 3, &regs->b);
+	NEXT;
+OP(0xD9)
+	/* SET 3,C */
+	set(regs, 3, &regs->c);
+	NEXT;
+OP(0xDA)
+	/* SET 3,D */
+	set(regs, 3, &regs->d);
+	NEXT;
+OP(0xDB)
+	/* SET 3,E */
+	set(regs, 3, &regs->e);
+	NEXT;
+OP(0xDC)
+	/* SET 3,H */
+	set(regs, 3, &regs->h);
+	NEXT;
+OP(0xDD)
+	/* SET 3,L */
+	set(regs, 3, &regs->l);
+	NEXT;
+OP(0xDE)
+	/* SET 3,(HL) */
+	tmp = get_mem(regs->hl);
+	set(regs, 3, &tmp);
+	write_mem(state, regs, regs->hl, tmp);
+	cycles = 16;
+	NEXT;
+OP(0xDF)
+	/* SET 3,A */
+	set(regs, 3, &regs->a);
+	NEXT;
+OP(0xE0)
+	/* SET 4,B */
+	set(regs, 4, &regs->b);
+	NEXT;
+OP(0xE1)
+	/* SET 4,C */
+	set(regs, 4, &regs->c);
+	NEXT;
+OP(0xE2)
+	/* SET 4,D */
+	set(regs, 4, &regs->d);
+	NEXT;
+OP(0xE3)
+	/* SET 4,E */
+	set(regs, 4, &regs->e);
+	NEXT;
+OP(0xE4)
+	/* SET 4,H */
+	set(regs, 4, &regs->h);
+	NEXT;
+OP(0xE5)
+	/* SET 4,L */
+	set(regs, 4, &regs->l);
+	NEXT;
+OP(0xE6)
+	/* SET 4,(HL) */
+	tmp = get_mem(regs->hl);
+	set(regs, 4, &tmp);
+	write_mem(state, regs, regs->hl, tmp);
+	cycles = 16;
+	NEXT;
+OP(0xE7)
+	/* SET 4,A */
+	set(regs, 4, &regs->a);
+	NEXT;
+OP(0xE8)
+	/* SET 5,B */
+	set(regs, 5, &regs->b);
+	NEXT;
+OP(0xE9)
+	/* SET 5,C */
+	set(regs, 5, &regs->c);
+	NEXT;
+OP(0xEA)
+	/* SET 5,D */
+	set(regs, 5, &regs->d);
+	NEXT;
+OP(0xEB)
+	/* SET 5,E */
+	set(regs, 5, &regs->e);
+	NEXT;
+OP(0xEC)
+	/* SET 5,H */
+	set(regs, 5, &regs->h);
+	NEXT;
+OP(0xED)
+	/* SET 5,L */
+	set(regs, 5, &regs->l);
+	NEXT;
+OP(0xEE)
+	/* SET 5,(HL) */
+	tmp = get_mem(regs->hl);
+	set(regs, 5, &tmp);
+	write_mem(state, regs, regs->hl, tmp);
+	cycles = 16;
+	NEXT;
+OP(0xEF)
+	/* SET 5,A */
+	set(regs, 5, &regs->a);
+	NEXT;
+OP(0xF0)
+	/* SET 6,B */
+	set(regs, 6, &regs->b);
+	NEXT;
+OP(0xF1)
+	/* SET 6,C */
+	set(regs, 6, &regs->c);
+	NEXT;
+OP(0xF2)
+	/* SET 6,D */
+	set(regs, 6, &regs->d);
+	NEXT;
+OP(0xF3)
+	/* SET 6,E */
+	set(regs, 6, &regs->e);
+	NEXT;
+OP(0xF4)
+	/* SET 6,H */
+	set(regs, 6, &regs->h);
+	NEXT;
+OP(0xF5)
+	/* SET 6,L */
+	set(regs, 6, &regs->l);
+	NEXT;
+OP(0xF6)
+	/* SET 6,(HL) */
+	tmp = get_mem(regs->hl);
+	set(regs, 6, &tmp);
+	write_mem(state, regs, regs->hl, tmp);
+	cycles = 16;
+	NEXT;
+OP(0xF7)
+	/* SET 6,A */
+	set(regs, 6, &regs->a);
+	NEXT;
+OP(0xF8)
+	/* SET 7,B */
+	set(regs, 7, &regs->b);
+	NEXT;
+OP(0xF9)
+	/* SET 7,C */
+	set(regs, 7, &regs->c);
+	NEXT;
+OP(0xFA)
+	/* SET 7,D */
+	set(regs, 7, &regs->d);
+	NEXT;
+OP(0xFB)
+	/* SET 7,E */
+	set(regs, 7, &regs->e);
+	NEXT;
+OP(0xFC)
+	/* SET 7,H */
+	set(regs, 7, &regs->h);
+	NEXT;
+OP(0xFD)
+	/* SET 7,L */
+	set(regs, 7, &regs->l);
+	NEXT;
+OP(0xFE)
+	/* SET 7,(HL) */
+	tmp = get_mem(regs->hl);
+	set(regs, 7, &tmp);
+	write_mem(state, regs, regs->hl, tmp);
+	cycles = 16;
+	NEXT;
+OP(0xFF)
+	/* SET 7,A */
+	set(regs, 7, &regs->a);
+	NEXT;
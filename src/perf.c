@@ -0,0 +1,99 @@
+#include <string.h>
+#include <time.h>
+
+#include "perf.h"
+#include "cpu.h"
+#include "gpu.h"
+#include "simd.h"
+
+int perf_enabled = 0;
+struct perf_counters perf;
+
+struct timespec perf_start;
+
+#define IDLE_LOOPS 16
+
+/* Skips per idle loop address, for the first IDLE_LOOPS loops */
+struct idle_stat {
+	uint16_t pc;
+	uint64_t skips;
+	uint64_t cycles;
+} idle_stats[IDLE_LOOPS];
+int idle_count = 0;
+
+void init_perf() {
+	perf_enabled = 1;
+	memset(&perf, 0, sizeof(perf));
+	clock_gettime(CLOCK_MONOTONIC, &perf_start);
+}
+
+/*
+ * Monotonic time in seconds for timing benchmarks.
+ */
+double perf_time() {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/*
+ * Records that the idle loop at pc was skipped ahead by cycles.
+ */
+void perf_idle(uint16_t pc, uint32_t cycles) {
+	int i;
+	perf.idle_skips++;
+	perf.idle_cycles += cycles;
+	for (i = 0; i < idle_count; i++) {
+		if (idle_stats[i].pc == pc)
+			break;
+	}
+	if (i == IDLE_LOOPS)
+		return;
+	if (i == idle_count)
+		idle_stats[idle_count++].pc = pc;
+	idle_stats[i].skips++;
+	idle_stats[i].cycles += cycles;
+}
+
+/*
+ * Records that a copy or fill loop stored bytes in one go.
+ */
+void perf_copy(uint32_t bytes) {
+	perf.copy_runs++;
+	perf.copy_bytes += bytes;
+}
+
+void fprintf_perf_info(FILE* stream) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	double secs = (now.tv_sec - perf_start.tv_sec)
+		+ (now.tv_nsec - perf_start.tv_nsec) / 1e9;
+	if (secs <= 0)
+		return;
+	fprintf(stream, "instructions: %llu (%.0f/s)\n",
+		(unsigned long long)perf.instructions, perf.instructions / secs);
+	fprintf(stream, "frames: %llu (%.1f/s)\n",
+		(unsigned long long)perf.frames, perf.frames / secs);
+	fprintf(stream, "idle loop skips: %llu (%llu cycles)\n",
+		(unsigned long long)perf.idle_skips,
+		(unsigned long long)perf.idle_cycles);
+	for (int i = 0; i < idle_count; i++) {
+		fprintf(stream, "  %04X: %llu skips, %llu cycles\n", idle_stats[i].pc,
+			(unsigned long long)idle_stats[i].skips,
+			(unsigned long long)idle_stats[i].cycles);
+	}
+	fprintf(stream, "copy loop runs: %llu (%llu bytes)\n",
+		(unsigned long long)perf.copy_runs,
+		(unsigned long long)perf.copy_bytes);
+}
+
+/*
+ * Runs the built in micro benchmarks. Returns nonzero if the ALU
+ * tables or the SIMD kernels did not match the code they replace.
+ */
+int run_benchmarks() {
+	int failed = bench_alu();
+	bench_render();
+	failed |= bench_simd();
+	return failed;
+}
@@ -0,0 +1,31 @@
+#ifndef PERF_H
+#define PERF_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/*
+ * Counters for measuring emulator throughput. They are always
+ * updated but only reported when perf_enabled is set, which also
+ * turns off the frame limiter.
+ */
+struct perf_counters {
+	uint64_t instructions;
+	uint64_t frames;
+	uint64_t idle_skips;
+	uint64_t idle_cycles;
+	uint64_t copy_runs;
+	uint64_t copy_bytes;
+};
+
+extern int perf_enabled;
+extern struct perf_counters perf;
+
+void init_perf();
+double perf_time();
+void perf_idle(uint16_t pc, uint32_t cycles);
+void perf_copy(uint32_t bytes);
+void fprintf_perf_info(FILE* stream);
+int run_benchmarks();
+
+#endif
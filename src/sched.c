@@ -0,0 +1,254 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sched.h"
+
+uint64_t cycle_count = 0;
+uint64_t next_event = NEVER;
+uint64_t event_at[EV_COUNT] = {NEVER, NEVER, NEVER, NEVER, NEVER};
+
+/*
+ * There are only a few kinds of event and each is pending at most
+ * once, so every kind has a slot and the queue is kept as the
+ * earliest slot.
+ */
+void update_next_event() {
+	int i;
+	next_event = NEVER;
+	for (i = 0; i < EV_COUNT; i++) {
+		if (event_at[i] < next_event)
+			next_event = event_at[i];
+	}
+}
+
+/*
+ * Makes e due at cycle at, replacing any time it was due before.
+ */
+void schedule(enum event e, uint64_t at) {
+	event_at[e] = at;
+	update_next_event();
+}
+
+void deschedule(enum event e) {
+	schedule(e, NEVER);
+}
+
+/* Stack of each component coroutine */
+#define STACK_SIZE 0x40000
+
+#if defined(__x86_64__) && defined(__ELF__)
+/*
+ * Switches stacks like libco: pushes the registers the SysV ABI has
+ * callees save, stores the stack pointer in from and returns on the
+ * stack in to after popping the same registers from it.
+ */
+typedef void *co_context;
+void co_swap(co_context *from, co_context *to);
+__asm__(
+	".text\n"
+	".globl co_swap\n"
+	".type co_swap, @function\n"
+	"co_swap:\n"
+	"	pushq %rbp\n"
+	"	pushq %rbx\n"
+	"	pushq %r12\n"
+	"	pushq %r13\n"
+	"	pushq %r14\n"
+	"	pushq %r15\n"
+	"	movq %rsp, (%rdi)\n"
+	"	movq (%rsi), %rsp\n"
+	"	popq %r15\n"
+	"	popq %r14\n"
+	"	popq %r13\n"
+	"	popq %r12\n"
+	"	popq %rbx\n"
+	"	popq %rbp\n"
+	"	ret\n"
+	".size co_swap, .-co_swap\n"
+);
+
+/*
+ * Lays out stack as if co_swap had left it, returning into entry
+ * with the stack aligned as after a call.
+ */
+void co_init(co_context *ctx, uint8_t *stack, size_t size, void (*entry)()) {
+	uint64_t *sp = (uint64_t *)(((uintptr_t)stack + size) & ~(uintptr_t)15);
+	*--sp = 0;
+	*--sp = (uint64_t)entry;
+	sp -= 6;
+	memset(sp, 0, 6 * sizeof(uint64_t));
+	*ctx = sp;
+}
+#else
+#include <ucontext.h>
+
+typedef ucontext_t co_context;
+
+void co_swap(co_context *from, co_context *to) {
+	swapcontext(from, to);
+}
+
+void co_init(co_context *ctx, uint8_t *stack, size_t size, void (*entry)()) {
+	getcontext(ctx);
+	ctx->uc_stack.ss_sp = stack;
+	ctx->uc_stack.ss_size = size;
+	ctx->uc_link = NULL;
+	makecontext(ctx, entry, 0);
+}
+#endif
+
+/*
+ * A component and, once start_driver() gave it a stack, its
+ * coroutine. clock is the cycle it last ran up to and next, if set,
+ * points at the cycle it next has work at. run is what it does when
+ * switched to next and caller the coroutine to switch back to, NULL
+ * while it is not running.
+ */
+struct coroutine {
+	void (*sync)();
+	void (*event)();
+	void (*run)();
+	uint64_t clock;
+	uint64_t *next;
+	co_context ctx;
+	struct coroutine *caller;
+	uint8_t *stack;
+};
+
+enum driver sched_driver = EVENT_DRIVER;
+struct coroutine components[COMP_COUNT];
+/* The CPU, which runs on the main stack with cycle_count as its clock */
+struct coroutine cpu_co;
+struct coroutine *active = &cpu_co;
+
+/*
+ * Selects the driver by name: "event", "coop" or "stretch".
+ * Returns nonzero if the name is unknown.
+ */
+int select_driver(char *name) {
+	if (!strcmp(name, "event"))
+		sched_driver = EVENT_DRIVER;
+	else if (!strcmp(name, "coop"))
+		sched_driver = COOP_DRIVER;
+	else if (!strcmp(name, "stretch"))
+		sched_driver = STRETCH_DRIVER;
+	else
+		return 1;
+	return 0;
+}
+
+/*
+ * Body of every component coroutine. Runs what it was switched to for
+ * up to cycle_count, the clock of the CPU that is waiting on it, and
+ * switches back.
+ */
+void component_main() {
+	struct coroutine *co, *caller;
+	for (;;) {
+		co = active;
+		co->run();
+		co->clock = cycle_count;
+		caller = co->caller;
+		co->caller = NULL;
+		active = caller;
+		co_swap(&co->ctx, &caller->ctx);
+	}
+}
+
+/*
+ * Switches to co to run run. A component that is already running, one
+ * a component it switched to observes, runs it on the current stack.
+ */
+void resume(struct coroutine *co, void (*run)()) {
+	if (co->caller || co == active) {
+		run();
+		return;
+	}
+	co->run = run;
+	co->caller = active;
+	active = co;
+	co_swap(&co->caller->ctx, &co->ctx);
+}
+
+/*
+ * Gives every component a coroutine unless EVENT_DRIVER is selected.
+ * Called once they are all added.
+ */
+void start_driver() {
+	int i;
+	if (sched_driver == EVENT_DRIVER)
+		return;
+	for (i = COMP_NONE + 1; i < COMP_COUNT; i++) {
+		struct coroutine *co = &components[i];
+		if (!co->sync)
+			continue;
+		co->stack = malloc(STACK_SIZE);
+		co->clock = cycle_count;
+		co_init(&co->ctx, co->stack, STACK_SIZE, component_main);
+	}
+	if (sched_driver == COOP_DRIVER)
+		schedule(EV_SLICE, cycle_count + SLICE_CYCLES);
+}
+
+uint8_t io_owner[0x100];
+
+/*
+ * Registers sync as what brings c up to cycle_count and event, if c
+ * has one, as what runs its event when it is due. next points at the
+ * cycle c next has work at, NULL if it has work every cycle.
+ */
+void add_component(enum component c, void (*sync)(), void (*event)(), uint64_t *next) {
+	components[c].sync = sync;
+	components[c].event = event;
+	components[c].next = next;
+}
+
+/*
+ * Makes reads of the I/O register at addr catch c up first.
+ */
+void own_port(enum component c, uint16_t addr) {
+	io_owner[addr & 0xFF] = c;
+}
+
+/*
+ * Catches c up to cycle_count. Nothing is called, or switched to, if
+ * the CPU has not got ahead of the work c has left.
+ */
+void sync_component(enum component c) {
+	struct coroutine *co = &components[c];
+	if (co->next ? *co->next > cycle_count : co->clock >= cycle_count)
+		return;
+	if (co->stack)
+		resume(co, co->sync);
+	else if (co->sync)
+		co->sync();
+}
+
+/*
+ * Runs the event of c that is due.
+ */
+void component_event(enum component c) {
+	struct coroutine *co = &components[c];
+	if (!co->stack)
+		co->event();
+	else
+		resume(co, co->event);
+}
+
+/*
+ * Catches every component up, for when all of memory is looked at.
+ */
+void sync_all() {
+	int i;
+	for (i = COMP_NONE + 1; i < COMP_COUNT; i++)
+		sync_component(i);
+}
+
+/*
+ * Lets every component catch up once a slice, COOP_DRIVER only.
+ */
+void slice_event() {
+	sync_all();
+	schedule(EV_SLICE, cycle_count + SLICE_CYCLES);
+}
@@ -0,0 +1,63 @@
+#ifndef SCHED_H
+#define SCHED_H
+
+#include <stdint.h>
+
+/* Time of an event that is not scheduled */
+#define NEVER UINT64_MAX
+
+/*
+ * Everything outside the CPU that happens at a given cycle. An event
+ * runs at the end of the first instruction that reaches its time and
+ * events due at the end of the same instruction run in this order.
+ */
+enum event {EV_GPU, EV_TIMA, EV_FRAME, EV_SLICE, EV_BUDGET, EV_COUNT};
+
+/*
+ * cycle_count counts the cycles since power up, event_at holds the
+ * time each event is due and next_event the earliest of them so the
+ * CPU only compares cycle_count against next_event per instruction.
+ */
+extern uint64_t cycle_count;
+extern uint64_t next_event;
+extern uint64_t event_at[EV_COUNT];
+
+void schedule(enum event e, uint64_t at);
+void deschedule(enum event e);
+
+/*
+ * Components that run on their own clock behind the CPU. One is only
+ * caught up to cycle_count when something could observe it: a read of
+ * an I/O port it owns, a write that changes how it runs, one of its
+ * events or sync_all(). In between it runs in long stretches instead
+ * of in step with every instruction.
+ */
+enum component {COMP_NONE, COMP_GPU, COMP_TIMER, COMP_APU, COMP_COUNT};
+
+/*
+ * How the components are run. EVENT_DRIVER calls their sync and event
+ * functions on the CPU's stack. The other two run each of them as a
+ * coroutine on its own stack that the CPU, which keeps the main
+ * stack, only switches to once it is ahead of a component it is about
+ * to observe or whose event is due. COOP_DRIVER also switches to every
+ * component once per SLICE_CYCLES, STRETCH_DRIVER leaves them alone
+ * for as long as nothing looks at them.
+ */
+enum driver {EVENT_DRIVER, COOP_DRIVER, STRETCH_DRIVER};
+
+/* Cycles between the EV_SLICE switches of COOP_DRIVER, a scan line */
+#define SLICE_CYCLES 456
+
+/* The component each I/O port and HRAM byte belongs to */
+extern uint8_t io_owner[0x100];
+
+int select_driver(char *name);
+void start_driver();
+void add_component(enum component c, void (*sync)(), void (*event)(), uint64_t *next);
+void own_port(enum component c, uint16_t addr);
+void sync_component(enum component c);
+void component_event(enum component c);
+void sync_all();
+void slice_event();
+
+#endif
@@ -0,0 +1,277 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "simd.h"
+#include "display.h"
+#include "perf.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SIMD_X86
+#include <immintrin.h>
+#endif
+
+void decode_tile_rows_c(const uint8_t *data, uint8_t *pix, uint8_t *flip) {
+	uint8_t color;
+	for (int line = 0; line < 8; line++) {
+		for (int i = 0; i < 8; i++) {
+			// colors are 2 bits so 2 rows are combined to get the color
+			color = ((data[line * 2 + 1] >> (7 - i) & 1) << 1) | (data[line * 2] >> (7 - i) & 1);
+			pix[line * 8 + i] = color;
+			flip[line * 8 + 7 - i] = color;
+		}
+	}
+}
+
+void map_row_c(uint8_t *dst, const uint8_t *row, const uint8_t *pix) {
+	for (int i = 0; i < 8; i++)
+		dst[i] = pix[row[i]];
+}
+
+void blend_row_c(uint8_t *dst, const uint8_t *row, uint8_t pal, int prty) {
+	uint8_t color, p;
+	for (int i = 0; i < 8; i++) {
+		color = row[i];
+		p = dst[i];
+		// sprite color 0 is transparent so do not draw
+		if (!color || (p & LINE_OBJ))
+			continue;
+		if (prty && (p & LINE_BG))
+			dst[i] = p | LINE_OBJ;
+		else
+			dst[i] = (p & LINE_BG) | LINE_OBJ | ((pal >> (2 * color)) & 0x3);
+	}
+}
+
+#ifdef SIMD_X86
+/*
+ * Decodes two rows at a time, one per 8 lanes. Each lane keeps the bit
+ * of its pixel by comparing the row byte, copied to every lane, masked
+ * with that bit against the bit itself.
+ */
+__attribute__((target("sse2")))
+void decode_tile_rows_sse2(const uint8_t *data, uint8_t *pix, uint8_t *flip) {
+	const __m128i bits = _mm_set_epi8(1, 2, 4, 8, 16, 32, 64, (char)128,
+		1, 2, 4, 8, 16, 32, 64, (char)128);
+	const __m128i bits_flip = _mm_set_epi8((char)128, 64, 32, 16, 8, 4, 2, 1,
+		(char)128, 64, 32, 16, 8, 4, 2, 1);
+	const __m128i one = _mm_set1_epi8(1);
+	const __m128i two = _mm_set1_epi8(2);
+	for (int line = 0; line < 8; line += 2) {
+		__m128i row0 = _mm_set_epi64x(0x0101010101010101ULL * data[line * 2 + 2],
+			0x0101010101010101ULL * data[line * 2]);
+		__m128i row1 = _mm_set_epi64x(0x0101010101010101ULL * data[line * 2 + 3],
+			0x0101010101010101ULL * data[line * 2 + 1]);
+		__m128i c = _mm_or_si128(
+			_mm_and_si128(_mm_cmpeq_epi8(_mm_and_si128(row0, bits), bits), one),
+			_mm_and_si128(_mm_cmpeq_epi8(_mm_and_si128(row1, bits), bits), two));
+		__m128i f = _mm_or_si128(
+			_mm_and_si128(_mm_cmpeq_epi8(_mm_and_si128(row0, bits_flip), bits_flip), one),
+			_mm_and_si128(_mm_cmpeq_epi8(_mm_and_si128(row1, bits_flip), bits_flip), two));
+		_mm_storeu_si128((__m128i *)&pix[line * 8], c);
+		_mm_storeu_si128((__m128i *)&flip[line * 8], f);
+	}
+}
+
+/*
+ * Looks the 8 color indices up in pix with one byte shuffle.
+ */
+__attribute__((target("ssse3")))
+void map_row_ssse3(uint8_t *dst, const uint8_t *row, const uint8_t *pix) {
+	uint32_t table;
+	memcpy(&table, pix, 4);
+	__m128i c = _mm_loadl_epi64((const __m128i *)row);
+	_mm_storel_epi64((__m128i *)dst, _mm_shuffle_epi8(_mm_cvtsi32_si128(table), c));
+}
+
+/*
+ * Works out which of the 8 pixels the sprite takes and which of those
+ * it shows at as lane masks and blends the new pixels in with them.
+ */
+__attribute__((target("ssse3")))
+void blend_row_ssse3(uint8_t *dst, const uint8_t *row, uint8_t pal, int prty) {
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i obj = _mm_set1_epi8(LINE_OBJ);
+	__m128i shades = _mm_cvtsi32_si128((pal & 0x3) | (pal >> 2 & 0x3) << 8
+		| (pal >> 4 & 0x3) << 16 | (pal >> 6 & 0x3) << 24);
+	__m128i c = _mm_loadl_epi64((const __m128i *)row);
+	__m128i p = _mm_loadl_epi64((const __m128i *)dst);
+	__m128i bg = _mm_and_si128(p, _mm_set1_epi8(LINE_BG));
+
+	__m128i take = _mm_andnot_si128(_mm_cmpeq_epi8(c, zero),
+		_mm_cmpeq_epi8(_mm_and_si128(p, obj), zero));
+	__m128i show = take;
+	if (prty)
+		show = _mm_and_si128(show, _mm_cmpeq_epi8(bg, zero));
+
+	__m128i np = _mm_or_si128(_mm_or_si128(bg, obj), _mm_shuffle_epi8(shades, c));
+	p = _mm_or_si128(p, _mm_and_si128(take, obj));
+	p = _mm_or_si128(_mm_and_si128(show, np), _mm_andnot_si128(show, p));
+	_mm_storel_epi64((__m128i *)dst, p);
+}
+#endif
+
+void (*decode_tile_rows)(const uint8_t *data, uint8_t *pix, uint8_t *flip) = decode_tile_rows_c;
+void (*map_row)(uint8_t *dst, const uint8_t *row, const uint8_t *pix) = map_row_c;
+void (*blend_row)(uint8_t *dst, const uint8_t *row, uint8_t pal, int prty) = blend_row_c;
+
+/*
+ * Points the kernels at the vector versions the host CPU has the
+ * instructions for.
+ */
+void init_simd() {
+#ifdef SIMD_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse2"))
+		decode_tile_rows = decode_tile_rows_sse2;
+	if (__builtin_cpu_supports("ssse3")) {
+		map_row = map_row_ssse3;
+		blend_row = blend_row_ssse3;
+	}
+#endif
+}
+
+/*
+ * Returns the index of the first byte a and b differ at, or -1.
+ */
+int first_diff(const uint8_t *a, const uint8_t *b, int n) {
+	for (int i = 0; i < n; i++) {
+		if (a[i] != b[i])
+			return i;
+	}
+	return -1;
+}
+
+/*
+ * Runs the C kernels and the ones init_simd() picked on the same
+ * inputs and prints the first output byte they differ at. Every pair
+ * of tile data bytes, every row of color indices and every pixel,
+ * palette and priority flag a sprite can be blended with are covered,
+ * each at every position in the row. Returns nonzero if they differ.
+ */
+int check_simd() {
+	uint8_t data[16], pix[64], flip[64], pix2[64], flip2[64];
+	uint8_t row[8], line[8], line2[8], bg[4] = {0x0, 0x5, 0x6, 0x7};
+	int i, j, k, d;
+
+	for (i = 0; i < 0x10000; i += 8) {
+		for (j = 0; j < 8; j++) {
+			data[j * 2] = i + j;
+			data[j * 2 + 1] = (i + j) >> 8;
+		}
+		decode_tile_rows_c(data, pix, flip);
+		decode_tile_rows(data, pix2, flip2);
+		d = first_diff(pix, pix2, 64);
+		if (d < 0 && (d = first_diff(flip, flip2, 64)) >= 0)
+			d += 64;
+		if (d >= 0) {
+			printf("simd tile decode differs at byte %d of rows %04X-%04X\n", d, i, i + 7);
+			return 1;
+		}
+	}
+
+	for (i = 0; i < 0x10000; i++) {
+		for (j = 0; j < 8; j++)
+			row[j] = i >> (j * 2) & 0x3;
+		map_row_c(line, row, bg);
+		map_row(line2, row, bg);
+		if ((d = first_diff(line, line2, 8)) >= 0) {
+			printf("simd row map differs at pixel %d of row %04X\n", d, i);
+			return 1;
+		}
+	}
+
+	// 4 colors over the 16 pixels LINE_SHADE, LINE_BG and LINE_OBJ make
+	for (i = 0; i < 0x200; i++) {
+		for (k = 0; k < 64; k += 8) {
+			for (j = 0; j < 8; j++) {
+				int v = (k + j + i) & 63;
+				row[j] = v & 0x3;
+				line[j] = line2[j] = v >> 2;
+			}
+			blend_row_c(line, row, i >> 1, i & 1);
+			blend_row(line2, row, i >> 1, i & 1);
+			if ((d = first_diff(line, line2, 8)) >= 0) {
+				printf("simd sprite blend differs at pixel %d, pal %02X prty %d\n", d, i >> 1, i & 1);
+				return 1;
+			}
+		}
+	}
+	return 0;
+}
+
+/*
+ * Times the C kernels against the ones init_simd() picked on the same
+ * random tiles and rows, after checking they agree. Returns nonzero
+ * without timing anything if they do not.
+ */
+volatile uint8_t simd_sink;
+
+int bench_simd() {
+	int n = 1 << 20, i, j;
+	uint8_t *data = malloc(n * 2 + 16);
+	uint8_t pix[64], flip[64], line[8], pal[4] = {0, 5, 6, 3};
+	uint8_t acc = 0;
+	double t;
+
+	init_simd();
+	if (check_simd()) {
+		free(data);
+		return 1;
+	}
+	srand(1);
+	for (i = 0; i < n * 2 + 16; i++)
+		data[i] = rand();
+
+	t = perf_time();
+	for (i = 0; i < n / 8; i++) {
+		decode_tile_rows_c(&data[i * 16], pix, flip);
+		acc ^= pix[i & 63] ^ flip[i * 7 & 63];
+	}
+	printf("tile decode c: %.2f ns/tile\n", (perf_time() - t) * 1e9 / (n / 8));
+	t = perf_time();
+	for (i = 0; i < n / 8; i++) {
+		decode_tile_rows(&data[i * 16], pix, flip);
+		acc ^= pix[i & 63] ^ flip[i * 7 & 63];
+	}
+	printf("tile decode simd: %.2f ns/tile\n", (perf_time() - t) * 1e9 / (n / 8));
+
+	// rows of color indices
+	for (i = 0; i < n * 2 + 16; i++)
+		data[i] &= 0x3;
+
+	t = perf_time();
+	for (i = 0; i < n; i++) {
+		map_row_c(line, &data[i * 2], pal);
+		acc ^= line[i & 7];
+	}
+	printf("row map c: %.2f ns/row\n", (perf_time() - t) * 1e9 / n);
+	t = perf_time();
+	for (i = 0; i < n; i++) {
+		map_row(line, &data[i * 2], pal);
+		acc ^= line[i & 7];
+	}
+	printf("row map simd: %.2f ns/row\n", (perf_time() - t) * 1e9 / n);
+
+	t = perf_time();
+	for (i = 0; i < n; i++) {
+		for (j = 0; j < 8 && !(i & 3); j++)
+			line[j] = data[i * 2 + j + 1] | (data[i * 2 + j + 2] & 1 ? LINE_BG : 0);
+		blend_row_c(line, &data[i * 2], 0xE4, i & 1);
+		acc ^= line[i & 7];
+	}
+	printf("sprite blend c: %.2f ns/row\n", (perf_time() - t) * 1e9 / n);
+	t = perf_time();
+	for (i = 0; i < n; i++) {
+		for (j = 0; j < 8 && !(i & 3); j++)
+			line[j] = data[i * 2 + j + 1] | (data[i * 2 + j + 2] & 1 ? LINE_BG : 0);
+		blend_row(line, &data[i * 2], 0xE4, i & 1);
+		acc ^= line[i & 7];
+	}
+	printf("sprite blend simd: %.2f ns/row\n", (perf_time() - t) * 1e9 / n);
+
+	// keeps the timed loops from being optimized away
+	simd_sink = acc;
+	free(data);
+	return 0;
+}
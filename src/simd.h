@@ -0,0 +1,26 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <stdint.h>
+
+/*
+ * Kernels the GPU draws 8 pixel tile rows with. Each has a plain C
+ * version, which they point at until init_simd() picks SSE2/SSSE3
+ * versions the host CPU supports.
+ *
+ * decode_tile_rows: decodes the 16 bytes of 2bpp tile data into 8 rows
+ * of 8 color indices in pix and the same rows X-flipped in flip.
+ *
+ * map_row: stores pix[color] for each color index of row in dst.
+ *
+ * blend_row: draws the sprite row of color indices over the line
+ * buffer pixels in dst (see draw_sprite_row in gpu.c).
+ */
+extern void (*decode_tile_rows)(const uint8_t *data, uint8_t *pix, uint8_t *flip);
+extern void (*map_row)(uint8_t *dst, const uint8_t *row, const uint8_t *pix);
+extern void (*blend_row)(uint8_t *dst, const uint8_t *row, uint8_t pal, int prty);
+
+void init_simd();
+int bench_simd();
+
+#endif